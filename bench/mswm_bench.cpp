@@ -0,0 +1,319 @@
+// Benchmark client for mswm. Opens N windows on a display managed by mswm, drives the window
+// manager with XTest input and measures from the client side how long each operation takes to
+// become visible. Results are written to stdout as JSON lines.
+//
+// Usage: mswm_bench <num_windows>
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XTest.h>
+#include <X11/keysym.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../config.hpp"
+
+using std::function;
+using std::string;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::steady_clock;
+
+static const int kWindowWidth = 200;
+static const int kWindowHeight = 150;
+static const int kEventTimeoutMs = 2000;
+static const int kFocusIterations = 100;
+static const int kSwitchIterations = 20;
+static const int kCloseIterations = 50;
+static const int kRestartIterations = 5;
+static const int kDragDurationMs = 1000;
+static const int kDragMotionIntervalUs = 1000;
+
+static Display* display;
+static Window root;
+static Atom WM_DELETE_WINDOW;
+static Atom MSWM_STATE;
+static Atom NET_CLIENT_LIST;
+static int num_windows;
+
+static long NowUs() {
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Waits for the next event, for at most timeout_ms
+static bool NextEvent(XEvent* e, int timeout_ms) {
+    if (XPending(display) == 0) {
+        pollfd fd = {ConnectionNumber(display), POLLIN, 0};
+        if (poll(&fd, 1, timeout_ms) <= 0 || XPending(display) == 0)
+            return false;
+    }
+    XNextEvent(display, e);
+    return true;
+}
+
+// Discards events left over from earlier operations
+static void Drain() {
+    XSync(display, false);
+    while (XPending(display) > 0) {
+        XEvent e;
+        XNextEvent(display, &e);
+    }
+}
+
+// Waits until predicate accepts an event. Returns the latency since start_us, or -1 on timeout.
+static long WaitFor(long start_us, const function<bool(const XEvent&)>& predicate) {
+    XEvent e;
+    while (NextEvent(&e, kEventTimeoutMs)) {
+        if (predicate(e))
+            return NowUs() - start_us;
+    }
+    return -1;
+}
+
+static void Report(const string& metric, vector<long> samples) {
+    samples.erase(std::remove(samples.begin(), samples.end(), -1), samples.end());
+    if (samples.empty()) {
+        printf("{\"windows\": %d, \"metric\": \"%s\", \"samples\": 0}\n", num_windows, metric.c_str());
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    long sum = 0;
+    for (long s : samples) {
+        sum += s;
+    }
+    printf("{\"windows\": %d, \"metric\": \"%s\", \"samples\": %zu, \"mean\": %ld, \"p50\": %ld, \"p99\": %ld, \"max\": %ld}\n",
+           num_windows,
+           metric.c_str(),
+           samples.size(),
+           sum / static_cast<long>(samples.size()),
+           samples[samples.size() / 2],
+           samples[samples.size() * 99 / 100],
+           samples.back());
+    fflush(stdout);
+}
+
+static void FakeKey(KeySym keysym, bool press) {
+    XTestFakeKeyEvent(display, XKeysymToKeycode(display, keysym), press, CurrentTime);
+}
+
+static void FakeChord(const vector<KeySym>& keysyms) {
+    for (KeySym k : keysyms) {
+        FakeKey(k, true);
+    }
+    for (auto it = keysyms.rbegin(); it != keysyms.rend(); ++it) {
+        FakeKey(*it, false);
+    }
+    XFlush(display);
+}
+
+static void FakeAltClick(unsigned int button, int x, int y) {
+    XTestFakeMotionEvent(display, -1, x, y, CurrentTime);
+    FakeKey(XK_Alt_L, true);
+    XTestFakeButtonEvent(display, button, true, CurrentTime);
+    XTestFakeButtonEvent(display, button, false, CurrentTime);
+    FakeKey(XK_Alt_L, false);
+    XFlush(display);
+}
+
+// Waits until the window manager has created its status bar
+static bool WaitForWindowManager() {
+    for (int i = 0; i < 100; i++) {
+        Window returned_root, parent;
+        Window* children;
+        unsigned int num_children;
+        if (XQueryTree(display, root, &returned_root, &parent, &children, &num_children)) {
+            if (children != nullptr)
+                XFree(children);
+            if (num_children > 0)
+                return true;
+        }
+        usleep(50000);
+    }
+    return false;
+}
+
+static vector<Window> BenchMap() {
+    vector<Window> windows;
+    vector<long> samples;
+    for (int i = 0; i < num_windows; i++) {
+        const Window w = XCreateSimpleWindow(display, root, 0, 0, kWindowWidth, kWindowHeight, 0, 0, 0xffffff);
+        XSetWMProtocols(display, w, &WM_DELETE_WINDOW, 1);
+        XSelectInput(display, w, StructureNotifyMask);
+        windows.push_back(w);
+
+        const long start = NowUs();
+        XMapWindow(display, w);
+        XFlush(display);
+        samples.push_back(WaitFor(start, [w](const XEvent& e) {
+            return e.type == MapNotify && e.xmap.window == w;
+        }));
+    }
+    Report("map_latency_us", samples);
+    return windows;
+}
+
+static void BenchFocus() {
+    // Alt + Tab changes the border of the newly focused window
+    vector<long> samples;
+    for (int i = 0; i < kFocusIterations; i++) {
+        Drain();
+        const long start = NowUs();
+        FakeChord({XK_Alt_L, XK_Tab});
+        samples.push_back(WaitFor(start, [](const XEvent& e) {
+            return e.type == ConfigureNotify && e.xconfigure.border_width == BORDER_WIDTH_ACTIVE;
+        }));
+    }
+    Report("focus_latency_us", samples);
+}
+
+static void BenchSwitch() {
+    // A switch is complete once one top-level window was mapped and another unmapped
+    XSelectInput(display, root, SubstructureNotifyMask);
+    vector<long> samples;
+    for (int i = 0; i < 2 * kSwitchIterations; i++) {
+        bool mapped = false;
+        bool unmapped = false;
+        Drain();
+        const long start = NowUs();
+        const KeySym direction = i % 2 == 0 ? XK_Right : XK_Left;
+        FakeChord({XK_Alt_L, XK_Control_L, direction});
+        samples.push_back(WaitFor(start, [&](const XEvent& e) {
+            if (e.type == MapNotify && e.xmap.event == root)
+                mapped = true;
+            if (e.type == UnmapNotify && e.xunmap.event == root)
+                unmapped = true;
+            return mapped && unmapped;
+        }));
+    }
+    XSelectInput(display, root, NoEventMask);
+    Report("workspace_switch_latency_us", samples);
+}
+
+static void BenchDrag() {
+    // Drag the topmost window with a 1000 Hz pointer and count the configures it receives
+    const int x = kWindowWidth / 2;
+    const int y = STATUS_BAR_HEIGHT + kWindowHeight / 2;
+    XTestFakeMotionEvent(display, -1, x, y, CurrentTime);
+    FakeKey(XK_Alt_L, true);
+    XTestFakeButtonEvent(display, Button1, true, CurrentTime);
+    Drain();
+
+    long configures = 0;
+    const long start = NowUs();
+    for (int i = 0; NowUs() - start < kDragDurationMs * 1000; i++) {
+        XTestFakeMotionEvent(display, -1, x + i % 200, y + i % 100, CurrentTime);
+        XFlush(display);
+        usleep(kDragMotionIntervalUs);
+
+        while (XPending(display) > 0) {
+            XEvent e;
+            XNextEvent(display, &e);
+            if (e.type == ConfigureNotify && !e.xconfigure.send_event)
+                configures++;
+        }
+    }
+    const long elapsed = NowUs() - start;
+
+    XTestFakeButtonEvent(display, Button1, false, CurrentTime);
+    FakeKey(XK_Alt_L, false);
+    XSync(display, false);
+
+    printf("{\"windows\": %d, \"metric\": \"drag_configures_per_s\", \"value\": %ld}\n",
+           num_windows, configures * 1000000 / elapsed);
+    fflush(stdout);
+}
+
+static void BenchClose(vector<Window>* windows) {
+    // Alt + Middle click asks the window under the pointer to close itself
+    vector<long> samples;
+    for (int i = 0; i < kCloseIterations && !windows->empty(); i++) {
+        Window closed = None;
+        Drain();
+        const long start = NowUs();
+        FakeAltClick(Button2, kWindowWidth / 2, STATUS_BAR_HEIGHT + kWindowHeight / 2);
+        samples.push_back(WaitFor(start, [&closed](const XEvent& e) {
+            if (e.type != ClientMessage || static_cast<Atom>(e.xclient.data.l[0]) != WM_DELETE_WINDOW)
+                return false;
+            closed = e.xclient.window;
+            return true;
+        }));
+
+        if (closed == None)
+            break;
+        XDestroyWindow(display, closed);
+        windows->erase(std::find(windows->begin(), windows->end(), closed));
+        XSync(display, false);
+    }
+    Report("close_latency_us", samples);
+}
+
+static void BenchRestart() {
+    // Alt + Shift + R restarts the window manager in place. The new process deletes the state
+    // snapshot while it starts up and publishes the client list once its event loop runs.
+    XSelectInput(display, root, PropertyChangeMask);
+    vector<long> samples;
+    for (int i = 0; i < kRestartIterations; i++) {
+        bool restored = false;
+        Drain();
+        const long start = NowUs();
+        FakeChord({XK_Alt_L, XK_Shift_L, XK_r});
+        samples.push_back(WaitFor(start, [&restored](const XEvent& e) {
+            if (e.type != PropertyNotify)
+                return false;
+            if (e.xproperty.atom == MSWM_STATE && e.xproperty.state == PropertyDelete)
+                restored = true;
+            return restored && e.xproperty.atom == NET_CLIENT_LIST;
+        }));
+    }
+    XSelectInput(display, root, NoEventMask);
+    Report("restart_latency_us", samples);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <num_windows>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    num_windows = atoi(argv[1]);
+
+    display = XOpenDisplay(nullptr);
+    if (display == nullptr) {
+        fprintf(stderr, "Failed to open X display %s\n", XDisplayName(nullptr));
+        return EXIT_FAILURE;
+    }
+    root = DefaultRootWindow(display);
+    WM_DELETE_WINDOW = XInternAtom(display, "WM_DELETE_WINDOW", false);
+    MSWM_STATE = XInternAtom(display, "_MSWM_STATE", false);
+    NET_CLIENT_LIST = XInternAtom(display, "_NET_CLIENT_LIST", false);
+
+    int event_base, error_base, major, minor;
+    if (!XTestQueryExtension(display, &event_base, &error_base, &major, &minor)) {
+        fprintf(stderr, "XTest extension is not available\n");
+        return EXIT_FAILURE;
+    }
+    if (!WaitForWindowManager()) {
+        fprintf(stderr, "No window manager is running\n");
+        return EXIT_FAILURE;
+    }
+
+    vector<Window> windows = BenchMap();
+    BenchFocus();
+    BenchSwitch();
+    BenchDrag();
+    BenchClose(&windows);
+    BenchRestart();
+
+    XCloseDisplay(display);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# Runs mswm on a headless Xvfb server and benchmarks it with 10, 100 and 1000 client windows.
+# Results are written as JSON lines to the file given as the first argument.
+
+set -e
+
+OUTPUT=${1:-bench_results.jsonl}
+BENCH_DISPLAY=${BENCH_DISPLAY:-:99}
+DIR=$(dirname "$0")
+
+Xvfb "$BENCH_DISPLAY" -screen 0 1280x720x24 -nolisten tcp &
+XVFB_PID=$!
+trap 'kill $MSWM_PID $XVFB_PID 2>/dev/null || true' EXIT
+
+# Wait for the server to accept connections
+for i in $(seq 50); do
+    [ -e "/tmp/.X11-unix/X${BENCH_DISPLAY#:}" ] && break
+    sleep 0.1
+done
+
+: > "$OUTPUT"
+for n in 10 100 1000; do
+    # A fresh window manager for every run, so that the state left by the previous run, including
+    # its in-place restarts, doesn't carry over. Restarts exec in place and keep the pid.
+    DISPLAY=$BENCH_DISPLAY "$DIR/../mswm" 2>/dev/null &
+    MSWM_PID=$!
+    DISPLAY=$BENCH_DISPLAY "$DIR/mswm_bench" "$n" | tee -a "$OUTPUT"
+    kill $MSWM_PID
+    wait $MSWM_PID || true
+done
@@ -0,0 +1,95 @@
+#include "client_registry.hpp"
+
+#include <glog/logging.h>
+
+ClientRegistry::ClientRegistry() {
+    // There is always at least one workspace
+    workspaces_.emplace_back();
+}
+
+Client* ClientRegistry::Find(Window w) const {
+    auto it = index_.find(w);
+    return it == index_.end() ? nullptr : it->second;
+}
+
+Client* ClientRegistry::Add(Window w, int workspace) {
+    CHECK(Find(w) == nullptr);
+    CHECK(workspace >= 0 && workspace < NumWorkspaces());
+
+    Client* c;
+    if (free_.empty()) {
+        pool_.emplace_back();
+        c = &pool_.back();
+    } else {
+        c = free_.back();
+        free_.pop_back();
+        *c = Client();
+    }
+
+    c->window = w;
+    index_[w] = c;
+    Link(c, workspace);
+    return c;
+}
+
+void ClientRegistry::Remove(Client* c) {
+    Unlink(c);
+    index_.erase(c->window);
+    c->window = None;
+    free_.push_back(c);
+}
+
+void ClientRegistry::MoveToWorkspace(Client* c, int workspace) {
+    CHECK(workspace >= 0 && workspace < NumWorkspaces());
+    Unlink(c);
+    Link(c, workspace);
+}
+
+Client* ClientRegistry::First(int workspace) const {
+    return workspaces_[workspace].head;
+}
+
+size_t ClientRegistry::NumClients(int workspace) const {
+    return workspaces_[workspace].size;
+}
+
+void ClientRegistry::AddWorkspace() {
+    workspaces_.emplace_back();
+}
+
+void ClientRegistry::TrimWorkspaces(int keep) {
+    while (NumWorkspaces() > keep + 1 && workspaces_.back().size == 0) {
+        workspaces_.pop_back();
+    }
+}
+
+void ClientRegistry::Link(Client* c, int workspace) {
+    WorkspaceList& list = workspaces_[workspace];
+    c->workspace = workspace;
+
+    // Append to the tail, which is the head's predecessor
+    if (list.head == nullptr) {
+        c->prev = c->next = c;
+        list.head = c;
+    } else {
+        c->next = list.head;
+        c->prev = list.head->prev;
+        c->prev->next = c;
+        list.head->prev = c;
+    }
+    list.size++;
+}
+
+void ClientRegistry::Unlink(Client* c) {
+    WorkspaceList& list = workspaces_[c->workspace];
+    if (c->next == c) {
+        list.head = nullptr;
+    } else {
+        c->prev->next = c->next;
+        c->next->prev = c->prev;
+        if (list.head == c)
+            list.head = c->next;
+    }
+    c->prev = c->next = nullptr;
+    list.size--;
+}
@@ -0,0 +1,97 @@
+#include <X11/Xlib.h>
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "layout.hpp"
+
+enum class BorderState {
+    kUnset,
+    kInactive,
+    kActive,
+};
+
+enum ClientFlags : unsigned int {
+    kClientDeleteWindow = 1 << 0,  // Supports WM_DELETE_WINDOW
+    kClientNetWMName = 1 << 1,     // Title comes from _NET_WM_NAME rather than WM_NAME
+    kClientSyncRequest = 1 << 2,   // Supports _NET_WM_SYNC_REQUEST
+};
+
+// Per-client record. Clients of the same workspace are linked in a circular list.
+struct Client {
+    Window window = None;
+    int workspace = 0;
+    int x = 0, y = 0;
+    unsigned int width = 0, height = 0;
+    unsigned int flags = 0;
+    BorderState border = BorderState::kUnset;
+
+    // Cached properties, kept current through PropertyNotify
+    std::string title;
+    std::string wm_class;
+    int min_width = 0, min_height = 0;
+    int max_width = 0, max_height = 0;
+    XID sync_counter = None;  // _NET_WM_SYNC_REQUEST_COUNTER
+
+    Client* prev = nullptr;
+    Client* next = nullptr;
+};
+
+// Table of all managed clients, indexed by window, plus the per-workspace client lists.
+// Records live in a pool that reuses freed slots, so pointers stay valid until the client is
+// removed and memory is bounded by the peak number of clients.
+class ClientRegistry {
+   public:
+    ClientRegistry();
+
+    Client* Find(Window w) const;
+    Client* Add(Window w, int workspace);
+    void Remove(Client* c);
+    void MoveToWorkspace(Client* c, int workspace);
+
+    // First client of a workspace, or nullptr if it is empty
+    Client* First(int workspace) const;
+    // Client after c in its workspace, wrapping around
+    Client* Next(const Client* c) const { return c->next; }
+
+    size_t NumClients() const { return index_.size(); }
+    size_t NumClients(int workspace) const;
+
+    int NumWorkspaces() const { return workspaces_.size(); }
+    Layout layout(int workspace) const { return workspaces_[workspace].layout; }
+    void SetLayout(int workspace, Layout layout) { workspaces_[workspace].layout = layout; }
+    void AddWorkspace();
+    // Drop empty workspaces from the end, keeping at least workspaces [0, keep]
+    void TrimWorkspaces(int keep);
+
+    template <typename F>
+    void ForEachClient(int workspace, F f) const {
+        // f may remove the client it is given
+        Client* c = First(workspace);
+        for (size_t n = NumClients(workspace); n > 0; n--) {
+            Client* next = c->next;
+            f(c);
+            c = next;
+        }
+    }
+
+   private:
+    struct WorkspaceList {
+        Client* head = nullptr;
+        size_t size = 0;
+        Layout layout = Layout::kFloating;
+    };
+
+    void Link(Client* c, int workspace);
+    void Unlink(Client* c);
+
+    std::deque<Client> pool_;
+    std::vector<Client*> free_;
+    std::unordered_map<Window, Client*> index_;
+    std::vector<WorkspaceList> workspaces_;
+};
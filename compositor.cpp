@@ -0,0 +1,427 @@
+#include "compositor.hpp"
+
+#include <X11/Xutil.h>
+#include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/shape.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <string>
+
+#include "config.hpp"
+
+using std::find;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+unique_ptr<Compositor> Compositor::Create(Display* display, XBackend* backend, const vector<Window>& containers) {
+    int event_base, error_base, damage_event_base;
+    if (!XCompositeQueryExtension(display, &event_base, &error_base) ||
+        !XDamageQueryExtension(display, &damage_event_base, &error_base) ||
+        !XFixesQueryExtension(display, &event_base, &error_base) ||
+        !XRenderQueryExtension(display, &event_base, &error_base)) {
+        LOG(WARNING) << "Compositing needs the Composite, Damage, XFixes and Render extensions";
+        return nullptr;
+    }
+
+    // Named window pixmaps need Composite 0.2 and region clipping XFixes 2
+    int composite_major = 0, composite_minor = 2;
+    int fixes_major = 2, fixes_minor = 0;
+    XCompositeQueryVersion(display, &composite_major, &composite_minor);
+    XFixesQueryVersion(display, &fixes_major, &fixes_minor);
+    if ((composite_major == 0 && composite_minor < 2) || fixes_major < 2) {
+        LOG(WARNING) << "Compositing needs Composite 0.2 and XFixes 2";
+        return nullptr;
+    }
+
+    const string selection_name = "_NET_WM_CM_S" + std::to_string(DefaultScreen(display));
+    const Atom selection = XInternAtom(display, selection_name.c_str(), false);
+    if (XGetSelectionOwner(display, selection) != None) {
+        LOG(WARNING) << "Another compositing manager is running";
+        return nullptr;
+    }
+
+    unique_ptr<Compositor> compositor(new Compositor(display, backend, damage_event_base, selection));
+    compositor->QueryChildren(compositor->root_);
+    for (Window w : containers) {
+        compositor->AddContainer(w);
+        compositor->QueryChildren(w);
+    }
+    LOG(INFO) << "Compositing " << compositor->windows_.size() << " windows";
+    return compositor;
+}
+
+Compositor::Compositor(Display* display, XBackend* backend, int damage_event_base, Atom selection)
+    : display_(display),
+      backend_(backend),
+      root_(DefaultRootWindow(display)),
+      damage_event_base_(damage_event_base),
+      width_(DisplayWidth(display, DefaultScreen(display))),
+      height_(DisplayHeight(display, DefaultScreen(display))) {
+    const int screen = DefaultScreen(display_);
+
+    selection_window_ = XCreateSimpleWindow(display_, root_, -1, -1, 1, 1, 0, 0, 0);
+    XSetSelectionOwner(display_, selection, selection_window_, CurrentTime);
+
+    // The overlay shows what we paint on top of everything, but must not take any input
+    overlay_ = XCompositeGetOverlayWindow(display_, root_);
+    const XserverRegion no_input = XFixesCreateRegion(display_, nullptr, 0);
+    XFixesSetWindowShapeRegion(display_, overlay_, ShapeInput, 0, 0, no_input);
+    XFixesDestroyRegion(display_, no_input);
+
+    XRenderPictFormat* format = XRenderFindVisualFormat(display_, DefaultVisual(display_, screen));
+    overlay_picture_ = XRenderCreatePicture(display_, overlay_, format, 0, nullptr);
+    back_buffer_ = XCreatePixmap(display_, root_, width_, height_, DefaultDepth(display_, screen));
+    back_picture_ = XRenderCreatePicture(display_, back_buffer_, format, 0, nullptr);
+
+    // The overlay starts out with undefined contents
+    XRectangle screen_rect = {0, 0, static_cast<unsigned short>(width_), static_cast<unsigned short>(height_)};
+    damage_ = XFixesCreateRegion(display_, &screen_rect, 1);
+    parts_ = XFixesCreateRegion(display_, nullptr, 0);
+    damaged_ = true;
+
+    XCompositeRedirectSubwindows(display_, root_, CompositeRedirectManual);
+    stacks_[root_];
+}
+
+Compositor::~Compositor() {
+    while (!windows_.empty()) {
+        Remove(windows_.begin()->first, false);
+    }
+    for (const auto& stack : stacks_) {
+        XCompositeUnredirectSubwindows(display_, stack.first, CompositeRedirectManual);
+    }
+
+    XFixesDestroyRegion(display_, parts_);
+    XFixesDestroyRegion(display_, damage_);
+    XRenderFreePicture(display_, back_picture_);
+    XFreePixmap(display_, back_buffer_);
+    XRenderFreePicture(display_, overlay_picture_);
+    XCompositeReleaseOverlayWindow(display_, root_);
+    XDestroyWindow(display_, selection_window_);
+}
+
+void Compositor::AddContainer(Window w) {
+    XCompositeRedirectSubwindows(display_, w, CompositeRedirectManual);
+    stacks_[w];
+}
+
+void Compositor::QueryChildren(Window parent) {
+    vector<Window> children;
+    if (!backend_->AwaitTree(backend_->RequestTree(parent), &children))
+        return;
+
+    // One round trip for all children with the XCB backend
+    vector<XBackend::GeometryCookie> geometry_cookies;
+    vector<XBackend::AttributesCookie> attributes_cookies;
+    for (Window w : children) {
+        geometry_cookies.push_back(backend_->RequestGeometry(w));
+        attributes_cookies.push_back(backend_->RequestAttributes(w));
+    }
+
+    for (size_t i = 0; i < children.size(); i++) {
+        XBackend::Geometry geometry;
+        XBackend::Attributes attributes;
+        const bool has_geometry = backend_->AwaitGeometry(geometry_cookies[i], &geometry);
+        const bool has_attributes = backend_->AwaitAttributes(attributes_cookies[i], &attributes);
+        if (!has_geometry || !has_attributes || children[i] == overlay_ || windows_.count(children[i]))
+            continue;
+
+        CompositedWindow* cw = Add(children[i], parent, geometry.x, geometry.y, geometry.width, geometry.height, geometry.border_width);
+        cw->mapped = attributes.map_state != IsUnmapped;
+        if (!attributes.input_only)
+            SetFormat(children[i], cw, attributes.visual);
+    }
+}
+
+Compositor::CompositedWindow* Compositor::Add(Window w,
+                                              Window parent,
+                                              int x, int y,
+                                              unsigned int width, unsigned int height,
+                                              unsigned int border_width) {
+    CompositedWindow& cw = windows_[w];
+    cw.parent = parent;
+    cw.x = x;
+    cw.y = y;
+    cw.width = width;
+    cw.height = height;
+    cw.border_width = border_width;
+    stacks_[parent].push_back(w);
+    return &cw;
+}
+
+void Compositor::Remove(Window w, bool destroyed) {
+    auto it = windows_.find(w);
+    if (it == windows_.end())
+        return;
+    CompositedWindow* cw = &it->second;
+
+    if (Visible(*cw))
+        DamageWindow(*cw);
+    if (cw->attributes_pending) {
+        XBackend::Attributes attributes;
+        backend_->AwaitAttributes(cw->attributes, &attributes);
+    }
+    DropPicture(cw);
+    if (cw->damage != None && !destroyed)
+        XDamageDestroy(display_, cw->damage);
+
+    vector<Window>& stack = stacks_[cw->parent];
+    stack.erase(find(stack.begin(), stack.end(), w));
+    windows_.erase(it);
+}
+
+void Compositor::ResolveAttributes(Window w, CompositedWindow* cw) {
+    if (!cw->attributes_pending)
+        return;
+    cw->attributes_pending = false;
+
+    XBackend::Attributes attributes;
+    if (backend_->AwaitAttributes(cw->attributes, &attributes) && !attributes.input_only)
+        SetFormat(w, cw, attributes.visual);
+}
+
+void Compositor::SetFormat(Window w, CompositedWindow* cw, VisualID visual) {
+    XVisualInfo template_info;
+    template_info.visualid = visual;
+    int num_infos;
+    XVisualInfo* info = XGetVisualInfo(display_, VisualIDMask, &template_info, &num_infos);
+    if (info == nullptr)
+        return;
+    cw->format = XRenderFindVisualFormat(display_, info->visual);
+    XFree(info);
+
+    if (cw->format != nullptr)
+        cw->damage = XDamageCreate(display_, w, XDamageReportNonEmpty);
+}
+
+void Compositor::DropPicture(CompositedWindow* cw) {
+    if (cw->picture != None) {
+        XRenderFreePicture(display_, cw->picture);
+        cw->picture = None;
+    }
+    if (cw->pixmap != None) {
+        XFreePixmap(display_, cw->pixmap);
+        cw->pixmap = None;
+    }
+}
+
+bool Compositor::Visible(const CompositedWindow& cw) const {
+    if (!cw.mapped)
+        return false;
+    if (cw.parent == root_)
+        return true;
+    auto parent = windows_.find(cw.parent);
+    return parent != windows_.end() && parent->second.mapped;
+}
+
+XRectangle Compositor::ScreenRect(const CompositedWindow& cw) const {
+    int x = cw.x;
+    int y = cw.y;
+    auto parent = windows_.find(cw.parent);
+    if (parent != windows_.end()) {
+        x += parent->second.x + parent->second.border_width;
+        y += parent->second.y + parent->second.border_width;
+    }
+    return {static_cast<short>(x),
+            static_cast<short>(y),
+            static_cast<unsigned short>(cw.width + 2 * cw.border_width),
+            static_cast<unsigned short>(cw.height + 2 * cw.border_width)};
+}
+
+void Compositor::DamageWindow(const CompositedWindow& cw) {
+    XRectangle rect = ScreenRect(cw);
+    XFixesSetRegion(display_, parts_, &rect, 1);
+    XFixesUnionRegion(display_, damage_, damage_, parts_);
+    damaged_ = true;
+}
+
+bool Compositor::HandleEvent(const XEvent& e) {
+    if (e.type == damage_event_base_ + XDamageNotify) {
+        OnDamageNotify(reinterpret_cast<const XDamageNotifyEvent&>(e));
+        return true;
+    }
+
+    switch (e.type) {
+        case CreateNotify:
+            OnCreateNotify(e.xcreatewindow);
+            break;
+        case DestroyNotify:
+            Remove(e.xdestroywindow.window, true);
+            stacks_.erase(e.xdestroywindow.window);
+            break;
+        case ReparentNotify:
+            OnReparentNotify(e.xreparent);
+            break;
+        case ConfigureNotify:
+            OnConfigureNotify(e.xconfigure);
+            break;
+        case MapNotify:
+            OnMapNotify(e.xmap);
+            break;
+        case UnmapNotify:
+            OnUnmapNotify(e.xunmap);
+            break;
+    }
+    return false;
+}
+
+void Compositor::OnCreateNotify(const XCreateWindowEvent& e) {
+    if (stacks_.count(e.parent) == 0 || windows_.count(e.window) || e.window == overlay_)
+        return;
+
+    // The visual is only needed once the window is mapped, so don't wait for it here
+    CompositedWindow* cw = Add(e.window, e.parent, e.x, e.y, e.width, e.height, e.border_width);
+    cw->attributes = backend_->RequestAttributes(e.window);
+    cw->attributes_pending = true;
+}
+
+void Compositor::OnReparentNotify(const XReparentEvent& e) {
+    // Reported to both the old and the new parent
+    auto it = windows_.find(e.window);
+    if (it == windows_.end() || it->second.parent == e.parent)
+        return;
+    if (stacks_.count(e.parent) == 0) {
+        Remove(e.window, false);
+        return;
+    }
+
+    CompositedWindow* cw = &it->second;
+    if (Visible(*cw))
+        DamageWindow(*cw);
+    DropPicture(cw);
+
+    vector<Window>& old_stack = stacks_[cw->parent];
+    old_stack.erase(find(old_stack.begin(), old_stack.end(), e.window));
+    stacks_[e.parent].push_back(e.window);
+    cw->parent = e.parent;
+    cw->x = e.x;
+    cw->y = e.y;
+    if (Visible(*cw))
+        DamageWindow(*cw);
+}
+
+void Compositor::OnConfigureNotify(const XConfigureEvent& e) {
+    auto it = windows_.find(e.window);
+    if (it == windows_.end())
+        return;
+    CompositedWindow* cw = &it->second;
+
+    // A move is a copy from the cached picture into the old and the new area
+    const bool visible = Visible(*cw);
+    if (visible)
+        DamageWindow(*cw);
+    if (static_cast<unsigned int>(e.width) != cw->width || static_cast<unsigned int>(e.height) != cw->height ||
+        static_cast<unsigned int>(e.border_width) != cw->border_width)
+        DropPicture(cw);
+    cw->x = e.x;
+    cw->y = e.y;
+    cw->width = e.width;
+    cw->height = e.height;
+    cw->border_width = e.border_width;
+
+    // Restack directly above the given sibling, or at the bottom
+    vector<Window>& stack = stacks_[cw->parent];
+    stack.erase(find(stack.begin(), stack.end(), e.window));
+    auto position = stack.begin();
+    if (e.above != None) {
+        position = find(stack.begin(), stack.end(), e.above);
+        if (position != stack.end())
+            position++;
+    }
+    stack.insert(position, e.window);
+
+    if (visible)
+        DamageWindow(*cw);
+}
+
+void Compositor::OnMapNotify(const XMapEvent& e) {
+    auto it = windows_.find(e.window);
+    if (it == windows_.end())
+        return;
+
+    ResolveAttributes(e.window, &it->second);
+    it->second.mapped = true;
+    if (Visible(it->second))
+        DamageWindow(it->second);
+}
+
+void Compositor::OnUnmapNotify(const XUnmapEvent& e) {
+    auto it = windows_.find(e.window);
+    if (it == windows_.end())
+        return;
+
+    if (Visible(it->second))
+        DamageWindow(it->second);
+    it->second.mapped = false;
+    DropPicture(&it->second);
+}
+
+void Compositor::OnDamageNotify(const XDamageNotifyEvent& e) {
+    // Subtracting the damage rearms the report
+    XDamageSubtract(display_, e.damage, None, parts_);
+
+    auto it = windows_.find(e.drawable);
+    if (it == windows_.end() || !Visible(it->second))
+        return;
+
+    // Damage is relative to the inside of the window's border
+    const XRectangle rect = ScreenRect(it->second);
+    XFixesTranslateRegion(display_, parts_, rect.x + it->second.border_width, rect.y + it->second.border_width);
+    XFixesUnionRegion(display_, damage_, damage_, parts_);
+    damaged_ = true;
+}
+
+void Compositor::Paint() {
+    if (!damaged_)
+        return;
+    damaged_ = false;
+
+    // Draw bottom to top into the back buffer, clipped to the damage
+    XFixesSetPictureClipRegion(display_, back_picture_, 0, 0, damage_);
+    const XRenderColor background = {static_cast<unsigned short>(((BG_COLOR >> 16) & 0xff) * 0x101),
+                                     static_cast<unsigned short>(((BG_COLOR >> 8) & 0xff) * 0x101),
+                                     static_cast<unsigned short>((BG_COLOR & 0xff) * 0x101),
+                                     0xffff};
+    XRenderFillRectangle(display_, PictOpSrc, back_picture_, &background, 0, 0, width_, height_);
+
+    for (Window w : stacks_[root_]) {
+        CompositedWindow* cw = &windows_[w];
+        auto children = stacks_.find(w);
+        if (children == stacks_.end()) {
+            PaintWindow(w, cw);
+            continue;
+        }
+        if (!cw->mapped)
+            continue;
+        for (Window child : children->second) {
+            PaintWindow(child, &windows_[child]);
+        }
+    }
+
+    // Then show the damaged region in one copy
+    XFixesSetPictureClipRegion(display_, overlay_picture_, 0, 0, damage_);
+    XRenderComposite(display_, PictOpSrc, back_picture_, None, overlay_picture_, 0, 0, 0, 0, 0, 0, width_, height_);
+    XFixesSetRegion(display_, damage_, nullptr, 0);
+}
+
+void Compositor::PaintWindow(Window w, CompositedWindow* cw) {
+    if (!Visible(*cw))
+        return;
+    ResolveAttributes(w, cw);
+    if (cw->format == nullptr)
+        return;
+
+    if (cw->picture == None) {
+        XRenderPictureAttributes pa;
+        pa.subwindow_mode = IncludeInferiors;
+        cw->pixmap = XCompositeNameWindowPixmap(display_, w);
+        cw->picture = XRenderCreatePicture(display_, cw->pixmap, cw->format, CPSubwindowMode, &pa);
+    }
+
+    // Windows with an alpha channel are blended over what is below them
+    const int op = cw->format->type == PictTypeDirect && cw->format->direct.alphaMask ? PictOpOver : PictOpSrc;
+    const XRectangle rect = ScreenRect(*cw);
+    XRenderComposite(display_, op, cw->picture, None, back_picture_, 0, 0, 0, 0, rect.x, rect.y, rect.width, rect.height);
+}
@@ -0,0 +1,103 @@
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xrender.h>
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "x_backend.hpp"
+
+// Compositing manager built into the window manager. Only compiled in with make COMPOSITOR=1.
+//
+// The top-level windows and the children of the container windows (the workspaces) are redirected
+// to offscreen storage, so moving or restacking a window exposes nothing and clients never repaint
+// for it. Each window keeps a cached picture of its storage, dropped when the window is resized or
+// unmapped. Client damage and the areas of configured, mapped and unmapped windows are collected in
+// a server-side region, and Paint() redraws only that region into a back buffer, which is then
+// copied to the composite overlay window in one operation. All drawing is done with XRender, which
+// the server implements in software.
+class Compositor {
+   public:
+    // Takes over compositing of the default screen. Returns nullptr if an extension is missing or
+    // another compositing manager is running. The children of containers are composited
+    // individually and the containers themselves are not drawn.
+    static std::unique_ptr<Compositor> Create(Display* display, XBackend* backend, const std::vector<Window>& containers);
+    ~Compositor();
+
+    // Composites the children of a container created after Create()
+    void AddContainer(Window w);
+    // Follows the window tree. Returns true if the event was the compositor's own and needs no
+    // further handling.
+    bool HandleEvent(const XEvent& e);
+    // Redraws the damaged region, if any
+    void Paint();
+
+   private:
+    struct CompositedWindow {
+        Window parent;
+        int x, y;
+        unsigned int width, height, border_width;
+        bool mapped = false;
+
+        // Resolved from the window's visual once its attributes arrive. InputOnly windows have no
+        // format and are never drawn.
+        bool attributes_pending = false;
+        XBackend::AttributesCookie attributes;
+        XRenderPictFormat* format = nullptr;
+
+        Damage damage = None;
+        Pixmap pixmap = None;
+        Picture picture = None;
+    };
+
+    Compositor(Display* display, XBackend* backend, int damage_event_base, Atom selection);
+
+    // Adds the existing children of a root or container window
+    void QueryChildren(Window parent);
+    CompositedWindow* Add(Window w, Window parent, int x, int y, unsigned int width, unsigned int height, unsigned int border_width);
+    // The server frees the damage of a destroyed window itself
+    void Remove(Window w, bool destroyed);
+    void ResolveAttributes(Window w, CompositedWindow* cw);
+    void SetFormat(Window w, CompositedWindow* cw, VisualID visual);
+    void DropPicture(CompositedWindow* cw);
+
+    // Whether the window is mapped and, for children of a container, the container is too
+    bool Visible(const CompositedWindow& cw) const;
+    // Outer rectangle of the window on the screen
+    XRectangle ScreenRect(const CompositedWindow& cw) const;
+    void DamageWindow(const CompositedWindow& cw);
+    void PaintWindow(Window w, CompositedWindow* cw);
+
+    void OnCreateNotify(const XCreateWindowEvent& e);
+    void OnReparentNotify(const XReparentEvent& e);
+    void OnConfigureNotify(const XConfigureEvent& e);
+    void OnMapNotify(const XMapEvent& e);
+    void OnUnmapNotify(const XUnmapEvent& e);
+    void OnDamageNotify(const XDamageNotifyEvent& e);
+
+    Display* display_;
+    XBackend* backend_;
+    const Window root_;
+    const int damage_event_base_;
+    unsigned int width_, height_;
+
+    std::unordered_map<Window, CompositedWindow> windows_;
+    // Children of the root window and of the containers, bottom-most first
+    std::unordered_map<Window, std::vector<Window>> stacks_;
+
+    // Owner of the _NET_WM_CM_S<screen> selection
+    Window selection_window_;
+    Window overlay_;
+    Picture overlay_picture_;
+    Pixmap back_buffer_;
+    Picture back_picture_;
+
+    // Accumulated damage in screen coordinates, and scratch space for a window's damage
+    XserverRegion damage_;
+    XserverRegion parts_;
+    bool damaged_ = false;
+};
@@ -10,4 +10,24 @@
 #define STATUS_BAR_BG_COLOR 0xffffff
 
 #define MIN_WINDOW_WIDTH 100
-#define MIN_WINDOW_HEIGHT 100
\ No newline at end of file
+#define MIN_WINDOW_HEIGHT 100
+
+// Share of the workspace width taken by the master window in the master/stack layout
+#define MASTER_RATIO_PERCENT 55
+
+// Command run by /bin/sh -c for Alt + Shift + Enter
+#define TERMINAL_COMMAND "xterm"
+
+// Maximum number of configures per second sent to a window while moving or resizing it
+#define DRAG_FRAME_RATE 60
+// Longest wait for a client to acknowledge a resize with _NET_WM_SYNC_REQUEST before sending the next
+#define SYNC_REQUEST_TIMEOUT_MS 100
+// Set to 1 to drag an outline instead of the window, which is configured once on release
+#define WIREFRAME_DRAG 0
+// Distance in pixels within which dragged windows snap to window and screen edges, 0 to disable
+#define SNAP_DISTANCE 10
+
+// strftime format of the status bar clock
+#define STATUS_CLOCK_FORMAT "%a %d %b %H:%M"
+// Battery shown in the status bar, from /sys/class/power_supply
+#define STATUS_BATTERY "BAT0"
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// Binary protocol of the mswm control socket. A request is a ControlRequestHeader followed by
+// num_commands ControlCommands, which are applied as one batch. The reply is a ControlReplyHeader
+// followed by num_records ControlClientRecords produced by the query commands of the batch. All
+// fields are in host byte order.
+
+const uint32_t kControlMagic = 0x4d57534d;  // "MSWM"
+const uint16_t kControlVersion = 1;
+
+enum ControlOpcode : uint8_t {
+    kControlFocus = 1,            // window
+    kControlMove = 2,             // window, args = {x, y}; fails on tiled workspaces
+    kControlResize = 3,           // window, args = {width, height}; fails on tiled workspaces
+    kControlSendToWorkspace = 4,  // window, args = {workspace}
+    kControlQueryClients = 5,     // Replies with a record for every client
+    kControlQueryGeometry = 6,    // window; replies with its record
+};
+
+struct ControlRequestHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_commands;
+};
+
+struct ControlCommand {
+    uint8_t opcode;
+    uint8_t reserved[3];
+    uint32_t window;
+    int32_t args[2];
+};
+
+struct ControlReplyHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t num_failed;  // Commands that named an unknown window or were invalid
+    uint32_t num_records;
+};
+
+struct ControlClientRecord {
+    uint32_t window;
+    int32_t workspace;
+    int32_t x, y;
+    uint32_t width, height;
+};
+
+static_assert(sizeof(ControlRequestHeader) == 8, "ControlRequestHeader must be packed");
+static_assert(sizeof(ControlCommand) == 16, "ControlCommand must be packed");
+static_assert(sizeof(ControlReplyHeader) == 12, "ControlReplyHeader must be packed");
+static_assert(sizeof(ControlClientRecord) == 24, "ControlClientRecord must be packed");
+
+// Socket path for a display, overridable with $MSWM_SOCKET
+inline std::string ControlSocketPath(const std::string& display_name) {
+    if (const char* path = getenv("MSWM_SOCKET"))
+        return path;
+    return "/tmp/mswm-" + std::to_string(getuid()) + "-" + display_name + ".sock";
+}
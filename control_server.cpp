@@ -0,0 +1,175 @@
+#include "control_server.hpp"
+
+#include <glog/logging.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <cerrno>
+#include <cstring>
+
+using std::string;
+
+// Upper bound on buffered request bytes per connection
+static const size_t kMaxRequestSize = sizeof(ControlRequestHeader) + 65535 * sizeof(ControlCommand);
+// Upper bound on buffered reply bytes for a peer that doesn't read its replies
+static const size_t kMaxReplySize = 16 << 20;
+
+ControlServer::ControlServer(const string& path, BatchHandler handler) : path_(path),
+                                                                         handler_(handler) {
+    sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (path_.size() >= sizeof(addr.sun_path)) {
+        LOG(ERROR) << "Control socket path is too long: " << path_;
+        return;
+    }
+    strcpy(addr.sun_path, path_.c_str());
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        PLOG(ERROR) << "Failed to create control socket";
+        return;
+    }
+
+    unlink(path_.c_str());
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        PLOG(ERROR) << "Failed to listen on control socket " << path_;
+        close(fd);
+        return;
+    }
+    chmod(path_.c_str(), S_IRUSR | S_IWUSR);
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    PCHECK(epoll_fd_ >= 0) << "Failed to create epoll instance";
+    epoll_event event = {0};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    CHECK_EQ(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event), 0);
+
+    listen_fd_ = fd;
+    LOG(INFO) << "Listening on control socket " << path_;
+}
+
+ControlServer::~ControlServer() {
+    while (!connections_.empty()) {
+        Close(connections_.begin()->first);
+    }
+    if (listen_fd_ >= 0) {
+        close(listen_fd_);
+        unlink(path_.c_str());
+    }
+    if (epoll_fd_ >= 0)
+        close(epoll_fd_);
+}
+
+void ControlServer::Dispatch() {
+    epoll_event events[16];
+    const int num_events = epoll_wait(epoll_fd_, events, 16, 0);
+    for (int i = 0; i < num_events; i++) {
+        const int fd = events[i].data.fd;
+        if (fd == listen_fd_) {
+            Accept();
+            continue;
+        }
+
+        if (connections_.count(fd) == 0)
+            continue;
+
+        // Read first so that a peer that sent a request and hung up still gets it handled
+        if (events[i].events & EPOLLIN)
+            Read(fd, &connections_[fd]);
+        if ((events[i].events & EPOLLOUT) && connections_.count(fd))
+            Write(fd, &connections_[fd]);
+        if ((events[i].events & (EPOLLERR | EPOLLHUP)) && connections_.count(fd))
+            Close(fd);
+    }
+}
+
+void ControlServer::Accept() {
+    int fd;
+    while ((fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        CHECK_EQ(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event), 0);
+        connections_[fd] = Connection();
+    }
+}
+
+void ControlServer::Read(int fd, Connection* connection) {
+    char buffer[4096];
+    ssize_t n = 1;
+    while (connection->in.size() < kMaxRequestSize && (n = read(fd, buffer, sizeof(buffer))) > 0) {
+        connection->in.append(buffer, n);
+    }
+    const bool closed = n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+
+    // Handle every complete request
+    size_t offset = 0;
+    while (connection->in.size() - offset >= sizeof(ControlRequestHeader)) {
+        ControlRequestHeader header;
+        memcpy(&header, connection->in.data() + offset, sizeof(header));
+        if (header.magic != kControlMagic || header.version != kControlVersion) {
+            LOG(WARNING) << "Closing control connection with bad request header";
+            Close(fd);
+            return;
+        }
+
+        const size_t size = sizeof(header) + header.num_commands * sizeof(ControlCommand);
+        if (connection->in.size() - offset < size)
+            break;
+
+        // Commands are copied out so that they are properly aligned
+        string commands = connection->in.substr(offset + sizeof(header), size - sizeof(header));
+        ControlReplyHeader reply = {kControlMagic, kControlVersion, 0, 0};
+        string records;
+        handler_(reinterpret_cast<const ControlCommand*>(commands.data()), header.num_commands, &reply, &records);
+
+        connection->out.append(reinterpret_cast<const char*>(&reply), sizeof(reply));
+        connection->out.append(records);
+        offset += size;
+        if (connection->out.size() > kMaxReplySize) {
+            LOG(WARNING) << "Closing control connection with " << connection->out.size() << " unread reply bytes";
+            Close(fd);
+            return;
+        }
+    }
+    connection->in.erase(0, offset);
+
+    Write(fd, connection);
+    if (closed && connections_.count(fd))
+        Close(fd);
+}
+
+void ControlServer::Write(int fd, Connection* connection) {
+    while (!connection->out.empty()) {
+        // A peer that hung up without reading its reply must not raise SIGPIPE, which would kill
+        // the window manager; EPIPE and ECONNRESET close the connection instead
+        const ssize_t n = send(fd, connection->out.data(), connection->out.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                Close(fd);
+                return;
+            }
+            break;
+        }
+        connection->out.erase(0, n);
+    }
+
+    // Wait for the socket to become writable only while there is output left
+    const bool want_write = !connection->out.empty();
+    if (want_write != connection->want_write) {
+        connection->want_write = want_write;
+        epoll_event event = {0};
+        event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event);
+    }
+}
+
+void ControlServer::Close(int fd) {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections_.erase(fd);
+}
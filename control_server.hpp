@@ -0,0 +1,45 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include "control_protocol.hpp"
+
+// Non-blocking server for the control socket. All of its sockets are watched by an internal epoll
+// instance whose fd can be polled by the caller's event loop; when it becomes readable, Dispatch()
+// serves every ready connection without blocking. Each complete request is handed to the batch
+// handler, which appends the reply records.
+class ControlServer {
+   public:
+    using BatchHandler = std::function<void(const ControlCommand* commands,
+                                            size_t num_commands,
+                                            ControlReplyHeader* header,
+                                            std::string* records)>;
+
+    ControlServer(const std::string& path, BatchHandler handler);
+    ~ControlServer();
+
+    // Whether the socket is listening
+    bool ok() const { return listen_fd_ >= 0; }
+    int fd() const { return epoll_fd_; }
+    void Dispatch();
+
+   private:
+    struct Connection {
+        std::string in;
+        std::string out;
+        bool want_write = false;
+    };
+
+    void Accept();
+    void Read(int fd, Connection* connection);
+    void Write(int fd, Connection* connection);
+    void Close(int fd);
+
+    std::string path_;
+    BatchHandler handler_;
+    int listen_fd_ = -1;
+    int epoll_fd_ = -1;
+    std::unordered_map<int, Connection> connections_;
+};
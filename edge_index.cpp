@@ -0,0 +1,52 @@
+#include "edge_index.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+using std::max;
+using std::min;
+
+void EdgeIndex::Reset(unsigned int width, unsigned int height) {
+    // Cells are cleared rather than freed, so their memory is reused by the next drag
+    cells_[kVertical].resize(width / kCellSize + 1);
+    cells_[kHorizontal].resize(height / kCellSize + 1);
+    for (auto& cells : cells_) {
+        for (auto& cell : cells) {
+            cell.clear();
+        }
+    }
+}
+
+void EdgeIndex::AddRect(const Rect& rect) {
+    const int right = rect.x + static_cast<int>(rect.width);
+    const int bottom = rect.y + static_cast<int>(rect.height);
+    AddEdge(kVertical, rect.x, rect.y, bottom);
+    AddEdge(kVertical, right, rect.y, bottom);
+    AddEdge(kHorizontal, rect.y, rect.x, right);
+    AddEdge(kHorizontal, bottom, rect.x, right);
+}
+
+void EdgeIndex::AddEdge(Axis axis, int position, int span_begin, int span_end) {
+    cells_[axis][Cell(axis, position)].push_back({position, span_begin, span_end});
+}
+
+bool EdgeIndex::Nearest(Axis axis, int position, int span_begin, int span_end, int distance, int* edge) const {
+    bool found = false;
+    int best_distance = distance + 1;
+    const int last = Cell(axis, position + distance);
+    for (int cell = Cell(axis, position - distance); cell <= last; cell++) {
+        for (const Edge& e : cells_[axis][cell]) {
+            const int d = abs(e.position - position);
+            if (d < best_distance && e.span_begin < span_end && span_begin < e.span_end) {
+                best_distance = d;
+                *edge = e.position;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+int EdgeIndex::Cell(Axis axis, int position) const {
+    return min(max(position / kCellSize, 0), static_cast<int>(cells_[axis].size()) - 1);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "layout.hpp"
+
+// Index of the window and screen edges that a dragged window snaps to. Vertical edges are bucketed
+// by x and horizontal edges by y in uniform grid cells, so a query only looks at the one or two
+// cells within the snap distance, however many windows there are.
+class EdgeIndex {
+   public:
+    enum Axis {
+        kVertical,    // Edges at an x position, spanning a range of y
+        kHorizontal,  // Edges at a y position, spanning a range of x
+    };
+
+    // Empties the index. Edges outside [0, width) x [0, height) still work, in the outermost cells.
+    void Reset(unsigned int width, unsigned int height);
+    // Adds the four edges of an outer window rectangle
+    void AddRect(const Rect& rect);
+    void AddEdge(Axis axis, int position, int span_begin, int span_end);
+
+    // Finds the edge nearest to position, at most distance away, whose span overlaps
+    // [span_begin, span_end). Returns false if there is none.
+    bool Nearest(Axis axis, int position, int span_begin, int span_end, int distance, int* edge) const;
+
+   private:
+    static const int kCellSize = 64;
+
+    struct Edge {
+        int position;
+        int span_begin, span_end;
+    };
+
+    int Cell(Axis axis, int position) const;
+
+    std::vector<std::vector<Edge>> cells_[2];
+};
@@ -0,0 +1,141 @@
+#include "event_log.hpp"
+
+#include <X11/Xutil.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+using std::min;
+using std::pair;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+// Size of the XEvent union member used by an event type. Unknown and extension events are stored whole.
+static size_t EventSize(int type) {
+    switch (type) {
+        case KeyPress:
+        case KeyRelease:
+            return sizeof(XKeyEvent);
+        case ButtonPress:
+        case ButtonRelease:
+            return sizeof(XButtonEvent);
+        case MotionNotify:
+            return sizeof(XMotionEvent);
+        case Expose:
+            return sizeof(XExposeEvent);
+        case CreateNotify:
+            return sizeof(XCreateWindowEvent);
+        case DestroyNotify:
+            return sizeof(XDestroyWindowEvent);
+        case UnmapNotify:
+            return sizeof(XUnmapEvent);
+        case MapNotify:
+            return sizeof(XMapEvent);
+        case MapRequest:
+            return sizeof(XMapRequestEvent);
+        case ReparentNotify:
+            return sizeof(XReparentEvent);
+        case ConfigureNotify:
+            return sizeof(XConfigureEvent);
+        case ConfigureRequest:
+            return sizeof(XConfigureRequestEvent);
+        case PropertyNotify:
+            return sizeof(XPropertyEvent);
+        case ClientMessage:
+            return sizeof(XClientMessageEvent);
+        case MappingNotify:
+            return sizeof(XMappingEvent);
+        default:
+            return sizeof(XEvent);
+    }
+}
+
+void FillEventLogHeader(Display* display,
+                        const vector<Window>& windows,
+                        const vector<pair<const char*, Atom>>& atoms,
+                        EventLogHeader* header) {
+    memset(header, 0, sizeof(*header));
+    header->magic = kEventLogMagic;
+    header->version = kEventLogVersion;
+    header->screen_width = DisplayWidth(display, DefaultScreen(display));
+    header->screen_height = DisplayHeight(display, DefaultScreen(display));
+
+    header->root = DefaultRootWindow(display);
+    header->next_resource = XAllocID(display);
+    for (size_t i = 0; i < min(windows.size(), sizeof(header->windows) / sizeof(header->windows[0])); i++) {
+        header->windows[i] = windows[i];
+    }
+    for (size_t i = 0; i < min(atoms.size(), sizeof(header->atoms) / sizeof(header->atoms[0])); i++) {
+        strncpy(header->atoms[i].name, atoms[i].first, sizeof(header->atoms[i].name) - 1);
+        header->atoms[i].atom = atoms[i].second;
+    }
+
+    int min_keycode, max_keycode, keysyms_per_keycode;
+    XDisplayKeycodes(display, &min_keycode, &max_keycode);
+    KeySym* keysyms = XGetKeyboardMapping(display, min_keycode, max_keycode - min_keycode + 1, &keysyms_per_keycode);
+    for (int keycode = min_keycode; keycode <= max_keycode; keycode++) {
+        header->keysyms[keycode] = keysyms[(keycode - min_keycode) * keysyms_per_keycode];
+    }
+    XFree(keysyms);
+
+    XModifierKeymap* modmap = XGetModifierMapping(display);
+    for (int modifier = 0; modifier < 8; modifier++) {
+        for (int i = 0; i < min(modmap->max_keypermod, 4); i++) {
+            header->modifiers[modifier][i] = modmap->modifiermap[modifier * modmap->max_keypermod + i];
+        }
+    }
+    XFreeModifiermap(modmap);
+}
+
+unique_ptr<EventRecorder> EventRecorder::Open(const string& path, const EventLogHeader& header) {
+    FILE* file = fopen(path.c_str(), "we");
+    if (file == nullptr)
+        return nullptr;
+
+    // Keep the event loop from blocking on small writes
+    setvbuf(file, nullptr, _IOFBF, 1 << 20);
+    fwrite(&header, sizeof(header), 1, file);
+    return unique_ptr<EventRecorder>(new EventRecorder(file));
+}
+
+EventRecorder::~EventRecorder() {
+    fclose(file_);
+}
+
+void EventRecorder::Record(const XEvent& e, int queued) {
+    Record(e, queued, duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+void EventRecorder::Record(const XEvent& e, int queued, uint64_t time_ns) {
+    EventLogRecord record = {0};
+    record.time_ns = time_ns;
+    record.size = EventSize(e.type);
+    record.queued = min(queued, 0xffff);
+    fwrite(&record, sizeof(record), 1, file_);
+    fwrite(&e, record.size, 1, file_);
+}
+
+bool ReadEventLog(const string& path, EventLogHeader* header, vector<RecordedEvent>* events) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = fread(header, sizeof(*header), 1, file) == 1 && header->magic == kEventLogMagic &&
+              header->version == kEventLogVersion;
+    EventLogRecord record;
+    while (ok && fread(&record, sizeof(record), 1, file) == 1) {
+        RecordedEvent event;
+        memset(&event.event, 0, sizeof(event.event));
+        event.time_ns = record.time_ns;
+        event.queued = record.queued;
+        ok = record.size <= sizeof(XEvent) && fread(&event.event, record.size, 1, file) == 1;
+        events->push_back(event);
+    }
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,85 @@
+#include <X11/Xlib.h>
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Binary log of the raw events the event loop reads, recorded when $MSWM_RECORD names a file and
+// replayed without an X server by replay/mswm_replay. The file is an EventLogHeader followed by an
+// EventLogRecord per event, each followed by the first size bytes of the XEvent, which cover the
+// structure of its event type. All fields are in host byte order.
+
+const uint32_t kEventLogMagic = 0x4c57534d;  // "MSWL"
+const uint32_t kEventLogVersion = 1;
+
+struct EventLogAtom {
+    char name[60];
+    uint32_t atom;
+};
+
+struct EventLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t screen_width;
+    uint32_t screen_height;
+    // Recorded events refer to windows and atoms by their ids on the recording server. A replay
+    // gives the window manager the same ids: the root, its windows when recording started, in the
+    // order they were created, the id allocated next, and the atoms it interned.
+    uint32_t root;
+    uint32_t next_resource;
+    uint32_t windows[16];
+    EventLogAtom atoms[32];
+    // Keyboard the key events were recorded with: the first keysym of every keycode, and up to four
+    // keycodes for each of the eight modifiers
+    uint32_t keysyms[256];
+    uint8_t modifiers[8][4];
+};
+
+struct EventLogRecord {
+    uint64_t time_ns;  // steady clock
+    uint16_t size;
+    // Events still queued when this one was read, so a replay reads the same batches
+    uint16_t queued;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(EventLogHeader) == 3192, "EventLogHeader must be packed");
+static_assert(sizeof(EventLogRecord) == 16, "EventLogRecord must be packed");
+
+struct RecordedEvent {
+    uint64_t time_ns;
+    int queued;
+    XEvent event;
+};
+
+// Describes the screen and keyboard of a display, and the window manager's windows and atoms
+void FillEventLogHeader(Display* display,
+                        const std::vector<Window>& windows,
+                        const std::vector<std::pair<const char*, Atom>>& atoms,
+                        EventLogHeader* header);
+
+// Appends events to a log. Writes are buffered, so the file is complete once the recorder is
+// destroyed.
+class EventRecorder {
+   public:
+    // Returns nullptr if the file can't be created
+    static std::unique_ptr<EventRecorder> Open(const std::string& path, const EventLogHeader& header);
+    ~EventRecorder();
+
+    void Record(const XEvent& e, int queued);
+    // Records an event with the given steady clock time instead of the current one
+    void Record(const XEvent& e, int queued, uint64_t time_ns);
+
+   private:
+    explicit EventRecorder(FILE* file) : file_(file) {}
+
+    FILE* file_;
+};
+
+// Reads a whole log. Returns false if the file is missing, truncated or not an event log.
+bool ReadEventLog(const std::string& path, EventLogHeader* header, std::vector<RecordedEvent>* events);
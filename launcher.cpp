@@ -0,0 +1,47 @@
+#include "launcher.hpp"
+
+#include <glog/logging.h>
+#include <spawn.h>
+
+#include <csignal>
+#include <cstring>
+
+extern char** environ;
+
+pid_t Spawn(const std::string& command) {
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_SETSID
+    // Detach from the window manager's session so its signals don't reach the child
+    flags |= POSIX_SPAWN_SETSID;
+#endif
+    posix_spawnattr_setflags(&attr, flags);
+
+    // Signals blocked for the event loop's signalfd would otherwise stay blocked in the child
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attr, &signals);
+    sigfillset(&signals);
+    posix_spawnattr_setsigdefault(&attr, &signals);
+
+    // Our own fds are close-on-exec; this also covers ones opened by libraries
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+    posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+#endif
+
+    pid_t pid;
+    char* argv[] = {const_cast<char*>("sh"), const_cast<char*>("-c"), const_cast<char*>(command.c_str()), nullptr};
+    const int error = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (error != 0) {
+        LOG(ERROR) << "Failed to spawn \"" << command << "\": " << strerror(error);
+        return -1;
+    }
+    return pid;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+
+// Runs command with /bin/sh -c in a new session and returns the child's pid, or -1 if it could not
+// be started. The child is started with posix_spawn, which doesn't copy the window manager's
+// address space, so launch time doesn't depend on its size. The child gets an empty signal mask,
+// default signal dispositions and only the standard fds.
+pid_t Spawn(const std::string& command);
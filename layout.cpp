@@ -0,0 +1,66 @@
+#include "layout.hpp"
+
+#include <cmath>
+
+#include "config.hpp"
+
+const char* LayoutSymbol(Layout layout) {
+    switch (layout) {
+        case Layout::kMasterStack:
+            return "[]=";
+        case Layout::kGrid:
+            return "###";
+        default:
+            return "><>";
+    }
+}
+
+// Splits [start, start + length) into n parts and returns part i
+static void Split(int start, unsigned int length, size_t n, size_t i, int* part_start, unsigned int* part_length) {
+    const int begin = start + static_cast<int>(length * i / n);
+    const int end = start + static_cast<int>(length * (i + 1) / n);
+    *part_start = begin;
+    *part_length = end - begin;
+}
+
+// Lays out n clients in lines across area, row by row if rows is true and column by column
+// otherwise. There are ceil(sqrt(n)) lines and client i goes into line i modulo that count; every
+// line is split evenly among its own clients. Until the line count changes, another client only
+// changes the line it joins, and the other lines keep their rectangles.
+static void StableGrid(size_t n, const Rect& area, bool rows, Rect* rects) {
+    const size_t lines = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+    for (size_t i = 0; i < n; i++) {
+        const size_t line = i % lines;
+        const size_t line_size = (n - line + lines - 1) / lines;
+        Rect& r = rects[i];
+        if (rows) {
+            Split(area.y, area.height, lines, line, &r.y, &r.height);
+            Split(area.x, area.width, line_size, i / lines, &r.x, &r.width);
+        } else {
+            Split(area.x, area.width, lines, line, &r.x, &r.width);
+            Split(area.y, area.height, line_size, i / lines, &r.y, &r.height);
+        }
+    }
+}
+
+void ComputeLayout(Layout layout, size_t n, const Rect& area, Rect* rects) {
+    if (n == 0)
+        return;
+
+    if (layout == Layout::kMasterStack) {
+        // A single client takes the whole area
+        if (n == 1) {
+            rects[0] = area;
+            return;
+        }
+
+        // The stack is a grid of rows on the right, so a few stack clients are stacked vertically
+        const unsigned int master_width = area.width * MASTER_RATIO_PERCENT / 100;
+        rects[0] = {area.x, area.y, master_width, area.height};
+        const Rect stack = {area.x + static_cast<int>(master_width), area.y, area.width - master_width, area.height};
+        StableGrid(n - 1, stack, true, rects + 1);
+    } else if (layout == Layout::kGrid) {
+        // Clients are placed row by row; a column with fewer clients has taller cells
+        StableGrid(n, area, false, rects);
+    }
+}
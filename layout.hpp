@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+// Placement of the clients of a workspace. Floating leaves windows where they are put; the tiling
+// layouts assign every client a rectangle of the workspace area.
+enum class Layout {
+    kFloating,
+    kMasterStack,  // First client on the left, the others stacked on the right
+    kGrid,
+    kNumLayouts,
+};
+
+struct Rect {
+    int x, y;
+    unsigned int width, height;
+
+    bool operator==(const Rect& other) const {
+        return x == other.x && y == other.y && width == other.width && height == other.height;
+    }
+    bool operator!=(const Rect& other) const { return !(*this == other); }
+};
+
+// Short name shown in the status bar
+const char* LayoutSymbol(Layout layout);
+
+// Computes the outer rectangles (including borders) of n tiled clients in area, in client order.
+// Cells are split at integer boundaries, so a cell whose bounds don't change keeps exactly the same
+// rectangle. Clients are assigned to cells so that adding or removing the last client changes only
+// one column of the grid or one row of the stack, except when the number of columns or rows
+// changes, at square numbers of clients.
+void ComputeLayout(Layout layout, size_t n, const Rect& area, Rect* rects);
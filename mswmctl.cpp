@@ -0,0 +1,146 @@
+// Command line client for the mswm control socket. Every command on the command line is sent in a
+// single batch, so they are applied together. Query results are printed as one line per client:
+// "window workspace x y width height".
+//
+// Usage: mswmctl <command> [<command> ...]
+//   focus <window>
+//   move <window> <x> <y>
+//   resize <window> <width> <height>
+//   send <window> <workspace>
+//   clients
+//   geometry <window>
+
+#include <X11/Xlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "control_protocol.hpp"
+
+using std::string;
+using std::vector;
+
+static void Usage(const char* program) {
+    fprintf(stderr,
+            "Usage: %s <command> [<command> ...]\n"
+            "  focus <window>\n"
+            "  move <window> <x> <y>\n"
+            "  resize <window> <width> <height>\n"
+            "  send <window> <workspace>\n"
+            "  clients\n"
+            "  geometry <window>\n",
+            program);
+    exit(EXIT_FAILURE);
+}
+
+// Parses the commands in argv into a batch, or returns false on a malformed command line
+static bool ParseCommands(int argc, char** argv, vector<ControlCommand>* commands) {
+    struct CommandSpec {
+        const char* name;
+        ControlOpcode opcode;
+        bool has_window;
+        int num_args;
+    };
+    static const CommandSpec kCommandSpecs[] = {
+        {"focus", kControlFocus, true, 0},
+        {"move", kControlMove, true, 2},
+        {"resize", kControlResize, true, 2},
+        {"send", kControlSendToWorkspace, true, 1},
+        {"clients", kControlQueryClients, false, 0},
+        {"geometry", kControlQueryGeometry, true, 0},
+    };
+
+    for (int i = 1; i < argc;) {
+        const CommandSpec* spec = nullptr;
+        for (const CommandSpec& s : kCommandSpecs) {
+            if (strcmp(argv[i], s.name) == 0)
+                spec = &s;
+        }
+        if (spec == nullptr || i + 1 + spec->has_window + spec->num_args > argc)
+            return false;
+        i++;
+
+        ControlCommand command = {0};
+        command.opcode = spec->opcode;
+        if (spec->has_window)
+            command.window = strtoul(argv[i++], nullptr, 0);
+        for (int j = 0; j < spec->num_args; j++) {
+            command.args[j] = strtol(argv[i++], nullptr, 0);
+        }
+        commands->push_back(command);
+    }
+    return !commands->empty() && commands->size() <= 65535;
+}
+
+static bool WriteAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = write(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool ReadAll(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        const ssize_t n = read(fd, p, size);
+        if (n <= 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    vector<ControlCommand> commands;
+    if (!ParseCommands(argc, argv, &commands))
+        Usage(argv[0]);
+
+    const string path = ControlSocketPath(XDisplayName(nullptr));
+    sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        perror(("Failed to connect to " + path).c_str());
+        return EXIT_FAILURE;
+    }
+
+    // Send the whole batch as one request
+    const ControlRequestHeader header = {kControlMagic, kControlVersion, static_cast<uint16_t>(commands.size())};
+    string request(reinterpret_cast<const char*>(&header), sizeof(header));
+    request.append(reinterpret_cast<const char*>(commands.data()), commands.size() * sizeof(ControlCommand));
+    ControlReplyHeader reply;
+    if (!WriteAll(fd, request.data(), request.size()) || !ReadAll(fd, &reply, sizeof(reply)) ||
+        reply.magic != kControlMagic || reply.version != kControlVersion) {
+        fprintf(stderr, "Bad reply from %s\n", path.c_str());
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < reply.num_records; i++) {
+        ControlClientRecord record;
+        if (!ReadAll(fd, &record, sizeof(record))) {
+            fprintf(stderr, "Truncated reply from %s\n", path.c_str());
+            return EXIT_FAILURE;
+        }
+        printf("0x%x %d %d %d %u %u\n", record.window, record.workspace, record.x, record.y, record.width, record.height);
+    }
+    close(fd);
+
+    if (reply.num_failed > 0) {
+        fprintf(stderr, "%u of %zu commands failed\n", reply.num_failed, commands.size());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
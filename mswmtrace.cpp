@@ -0,0 +1,69 @@
+// Decodes a trace file written by mswm into one line per record:
+// "seconds point code window arg", with seconds relative to the first record.
+//
+// Usage: mswmtrace <trace file>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "trace.hpp"
+#include "utils.hpp"
+
+// Name of a record's code, which is an event type or a request code depending on the point
+static string CodeToString(const TraceRecord& record) {
+    switch (record.point) {
+        case kTraceEvent:
+        case kTraceIgnoredEvent:
+            if (record.code < 36)
+                return XEventCodeToString(record.code);
+            break;
+        case kTraceXError:
+            // XRequestCodeToString prints codes past its table, such as extension requests, as numbers
+            if (record.code <= 0xff)
+                return XRequestCodeToString(record.code);
+            break;
+        default:
+            return "-";
+    }
+    return std::to_string(record.code);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <trace file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == nullptr) {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != kTraceMagic || header.version != kTraceVersion) {
+        fprintf(stderr, "%s is not an mswm trace file\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t start_ns = 0;
+    for (uint64_t i = 0; i < header.num_records; i++) {
+        TraceRecord record;
+        if (fread(&record, sizeof(record), 1, file) != 1) {
+            fprintf(stderr, "Truncated trace file %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        if (i == 0)
+            start_ns = record.time_ns;
+
+        printf("%12.6f %-14s %-18s 0x%08x %u\n",
+               (record.time_ns - start_ns) / 1e9,
+               TracePointName(record.point),
+               CodeToString(record).c_str(),
+               record.window,
+               record.arg);
+    }
+    fclose(file);
+    return EXIT_SUCCESS;
+}
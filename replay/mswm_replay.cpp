@@ -0,0 +1,242 @@
+// Replays an event log recorded with MSWM_RECORD=<file> through the window manager, against a stub
+// Xlib instead of an X server (see xlib_stub.hpp), and reports the time and requests spent per event
+// type as JSON lines. Without a server, and with drags paced by the recorded event times, replays
+// are deterministic.
+//
+// Usage: mswm_replay <event log>
+//        mswm_replay --generate <event log> <num_windows>
+//
+// --generate writes a synthetic session instead: num_windows windows are mapped, then focus is
+// cycled, a window is dragged, the layout is cycled and workspaces are switched.
+
+#include <X11/keysym.h>
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../event_log.hpp"
+#include "../launcher.hpp"
+#include "../utils.hpp"
+#include "../window_manager.hpp"
+#include "xlib_stub.hpp"
+
+using std::string;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+static const Window kRoot = 0x1e0;
+static const Window kFirstClient = 0x200000;
+static const int kScreenWidth = 1920;
+static const int kScreenHeight = 1080;
+static const int kFocusIterations = 100;
+static const int kDragMotions = 10000;
+static const int kMotionBatch = 4;
+static const int kSwitchIterations = 20;
+
+// Keycodes of a pc105 keyboard
+static const KeyCode kShiftKeycode = 50;
+static const KeyCode kLockKeycode = 66;
+static const KeyCode kControlKeycode = 37;
+static const KeyCode kAltKeycode = 64;
+static const KeyCode kNumLockKeycode = 77;
+static const KeyCode kTabKeycode = 23;
+static const KeyCode kReturnKeycode = 36;
+static const KeyCode kSpaceKeycode = 65;
+static const KeyCode kLeftKeycode = 113;
+static const KeyCode kRightKeycode = 114;
+
+// Programs are not started during a replay
+pid_t Spawn(const string& command) {
+    return -1;
+}
+
+class SessionWriter {
+   public:
+    explicit SessionWriter(EventRecorder* recorder) : recorder_(recorder) {}
+
+    // Writes events that arrive together, at the current time in milliseconds
+    void Batch(const vector<XEvent>& events) {
+        for (size_t i = 0; i < events.size(); i++) {
+            recorder_->Record(events[i], events.size() - i - 1, time_ * 1000000);
+        }
+    }
+
+    void Map(Window w) {
+        XEvent e = {0};
+        e.xmaprequest.type = MapRequest;
+        e.xmaprequest.parent = kRoot;
+        e.xmaprequest.window = w;
+        Batch({e});
+    }
+
+    void Key(KeyCode keycode, unsigned int state) {
+        XEvent e = {0};
+        e.xkey.type = KeyPress;
+        e.xkey.window = kRoot;
+        e.xkey.root = kRoot;
+        e.xkey.keycode = keycode;
+        e.xkey.state = state;
+        e.xkey.same_screen = True;
+        e.xkey.time = time_++;
+        Batch({e});
+        e.xkey.type = KeyRelease;
+        e.xkey.time = time_++;
+        Batch({e});
+    }
+
+    XEvent Pointer(int type, Window subwindow, int x, int y, unsigned int state) {
+        XEvent e = {0};
+        e.xbutton.type = type;
+        e.xbutton.window = kRoot;
+        e.xbutton.root = kRoot;
+        e.xbutton.subwindow = subwindow;
+        e.xbutton.x = e.xbutton.x_root = x;
+        e.xbutton.y = e.xbutton.y_root = y;
+        e.xbutton.state = state;
+        e.xbutton.button = type == MotionNotify ? 0 : Button1;
+        e.xbutton.same_screen = True;
+        e.xbutton.time = time_++;
+        return e;
+    }
+
+   private:
+    EventRecorder* recorder_;
+    Time time_ = 1;
+};
+
+static bool GenerateSession(const string& path, int num_windows) {
+    EventLogHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kEventLogMagic;
+    header.version = kEventLogVersion;
+    header.screen_width = kScreenWidth;
+    header.screen_height = kScreenHeight;
+    header.root = kRoot;
+    header.next_resource = 0x01000000;
+
+    const std::pair<KeyCode, KeySym> keys[] = {
+        {kShiftKeycode, XK_Shift_L}, {kLockKeycode, XK_Caps_Lock}, {kControlKeycode, XK_Control_L},
+        {kAltKeycode, XK_Alt_L}, {kNumLockKeycode, XK_Num_Lock}, {kTabKeycode, XK_Tab},
+        {kReturnKeycode, XK_Return}, {kSpaceKeycode, XK_space}, {kLeftKeycode, XK_Left},
+        {kRightKeycode, XK_Right},
+    };
+    for (const auto& key : keys) {
+        header.keysyms[key.first] = key.second;
+    }
+    header.modifiers[ShiftMapIndex][0] = kShiftKeycode;
+    header.modifiers[LockMapIndex][0] = kLockKeycode;
+    header.modifiers[ControlMapIndex][0] = kControlKeycode;
+    header.modifiers[Mod1MapIndex][0] = kAltKeycode;
+    header.modifiers[Mod2MapIndex][0] = kNumLockKeycode;
+
+    std::unique_ptr<EventRecorder> recorder = EventRecorder::Open(path, header);
+    if (!recorder)
+        return false;
+    SessionWriter session(recorder.get());
+
+    for (int i = 0; i < num_windows; i++) {
+        session.Map(kFirstClient + i);
+    }
+    for (int i = 0; i < kFocusIterations; i++) {
+        session.Key(kTabKeycode, Mod1Mask);
+    }
+
+    // Drag the focused window with a 1000 Hz pointer, with motion events arriving a few at a time
+    const Window dragged = kFirstClient + num_windows - 1;
+    session.Batch({session.Pointer(ButtonPress, dragged, 100, 100, Mod1Mask)});
+    for (int i = 0; i < kDragMotions; i += kMotionBatch) {
+        vector<XEvent> motions;
+        for (int j = i; j < std::min(i + kMotionBatch, kDragMotions); j++) {
+            motions.push_back(session.Pointer(MotionNotify, dragged, 100 + j % 800, 100 + j % 600, Mod1Mask | Button1Mask));
+        }
+        session.Batch(motions);
+    }
+    session.Batch({session.Pointer(ButtonRelease, dragged, 300, 200, Mod1Mask | Button1Mask)});
+
+    // Through every layout back to floating
+    for (int i = 0; i < 3; i++) {
+        session.Key(kSpaceKeycode, Mod1Mask);
+    }
+    for (int i = 0; i < kSwitchIterations; i++) {
+        session.Key(i % 2 == 0 ? kRightKeycode : kLeftKeycode, Mod1Mask | ControlMask);
+    }
+    return true;
+}
+
+static void Report(int type, const ReplayEventStats& event_stats) {
+    vector<uint64_t> samples = event_stats.latencies_ns;
+    std::sort(samples.begin(), samples.end());
+    uint64_t sum = 0;
+    for (uint64_t s : samples) {
+        sum += s;
+    }
+    printf("{\"event\": \"%s\", \"samples\": %zu, \"coalesced\": %lu, \"mean_ns\": %lu, \"p50_ns\": %lu, "
+           "\"p99_ns\": %lu, \"max_ns\": %lu, \"requests_per_event\": %.2f, \"round_trips_per_event\": %.2f}\n",
+           XEventCodeToString(type).c_str(),
+           samples.size(),
+           event_stats.coalesced,
+           sum / samples.size(),
+           samples[samples.size() / 2],
+           samples[samples.size() * 99 / 100],
+           samples.back(),
+           static_cast<double>(event_stats.requests) / samples.size(),
+           static_cast<double>(event_stats.round_trips) / samples.size());
+}
+
+int main(int argc, char** argv) {
+    if (argc == 4 && strcmp(argv[1], "--generate") == 0) {
+        if (!GenerateSession(argv[2], atoi(argv[3]))) {
+            perror(argv[2]);
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <event log>\n       %s --generate <event log> <num_windows>\n", argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    EventLogHeader header;
+    vector<RecordedEvent> events;
+    if (!ReadEventLog(argv[1], &header, &events)) {
+        fprintf(stderr, "%s is not a complete mswm event log\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    const size_t num_events = events.size();
+    LoadReplay(header, std::move(events));
+
+    google::InitGoogleLogging(argv[0]);
+    unsetenv("MSWM_RECORD");
+    std::unique_ptr<WindowManager> window_manager(WindowManager::Create());
+    if (!window_manager) {
+        fprintf(stderr, "Failed to initialize window manager\n");
+        return EXIT_FAILURE;
+    }
+
+    const steady_clock::time_point start_time = steady_clock::now();
+    window_manager->SetClock(ReplayClock);
+    window_manager->Run();
+    const long elapsed_ms = duration_cast<milliseconds>(steady_clock::now() - start_time).count();
+
+    const ReplayStats& stats = GetReplayStats();
+    for (int type = 0; type < LASTEvent; type++) {
+        if (!stats.event_types[type].latencies_ns.empty())
+            Report(type, stats.event_types[type]);
+    }
+    printf("{\"event\": \"total\", \"events\": %zu, \"elapsed_ms\": %ld, \"requests\": %lu, \"round_trips\": %lu, "
+           "\"flushes\": %lu}\n",
+           num_events,
+           elapsed_ms,
+           stats.requests,
+           stats.round_trips,
+           stats.flushes);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,781 @@
+#include "xlib_stub.hpp"
+
+#include <X11/Xutil.h>
+#include <X11/extensions/sync.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+// Display is opaque, but the Xlib macros the window manager uses read the fields of _XPrivDisplay
+typedef std::remove_pointer<_XPrivDisplay>::type PrivDisplay;
+
+// Graphics contexts only need an id
+struct _XGC {
+    GContext gid;
+};
+
+static const unsigned int kMinKeycode = 8;
+static const unsigned int kMaxKeycode = 255;
+static const int kFontWidth = 6;
+// Ids of resources created before the replayed events start, and of atoms the log doesn't know
+static const XID kStubResourceBase = 0x1f000000;
+static const Atom kStubAtomBase = 0x1000;
+
+struct StubWindow {
+    Window parent;
+    int x = 0, y = 0;
+    unsigned int width = 640, height = 480, border_width = 0;
+    bool mapped = false;
+};
+
+static EventLogHeader header;
+static vector<RecordedEvent> events;
+// events[next_event, queue_end) are queued
+static size_t next_event = 0;
+static size_t queue_end = 0;
+static bool can_read = true;
+static bool started = false;
+static bool finished = false;
+// Recorded time of the event read last
+static uint64_t event_time_ns = 0;
+
+static PrivDisplay* display;
+static Screen screen;
+static Visual visual;
+static char display_name[] = ":replay";
+static XErrorHandler error_handler;
+
+static XID next_resource = kStubResourceBase;
+static size_t num_created_windows = 0;
+static unordered_map<Window, StubWindow> windows;
+static unordered_map<string, Atom> atoms;
+static Atom next_atom = kStubAtomBase;
+
+static ReplayStats stats;
+// Event being handled, if any
+static bool in_event = false;
+static bool peeked = false;
+static int event_type;
+static steady_clock::time_point event_start_time;
+static uint64_t event_start_requests;
+static uint64_t event_start_round_trips;
+
+void LoadReplay(const EventLogHeader& log_header, vector<RecordedEvent> log_events) {
+    header = log_header;
+    events = std::move(log_events);
+    for (const EventLogAtom& atom : header.atoms) {
+        if (atom.name[0] != '\0')
+            atoms[string(atom.name, strnlen(atom.name, sizeof(atom.name)))] = atom.atom;
+    }
+}
+
+const ReplayStats& GetReplayStats() {
+    return stats;
+}
+
+steady_clock::time_point ReplayClock() {
+    return steady_clock::time_point(nanoseconds(event_time_ns));
+}
+
+static void SendRequest(bool reply) {
+    display->request++;
+    stats.requests++;
+    if (reply) {
+        display->last_request_read = display->request;
+        stats.round_trips++;
+    }
+}
+
+static XID AllocResource() {
+    return next_resource++;
+}
+
+static Window CreateWindow(Window parent, int x, int y, unsigned int width, unsigned int height, unsigned int border_width) {
+    SendRequest(false);
+    // The windows that existed when recording started get their recorded ids
+    Window w = 0;
+    if (!started && num_created_windows < sizeof(header.windows) / sizeof(header.windows[0]))
+        w = header.windows[num_created_windows];
+    if (w == 0)
+        w = AllocResource();
+    num_created_windows++;
+
+    StubWindow& window = windows[w];
+    window.parent = parent;
+    window.x = x;
+    window.y = y;
+    window.width = width;
+    window.height = height;
+    window.border_width = border_width;
+    return w;
+}
+
+static StubWindow& FindWindow(Window w) {
+    auto it = windows.find(w);
+    if (it != windows.end())
+        return it->second;
+    StubWindow& window = windows[w];
+    window.parent = header.root;
+    return window;
+}
+
+// Charges the time and requests since the current event was read to its type
+static void EndEvent() {
+    if (!in_event)
+        return;
+    in_event = false;
+    // Extension events are not tracked, nor the empty events read after the end of the log
+    if (event_type < KeyPress || event_type >= LASTEvent)
+        return;
+
+    ReplayEventStats& event_stats = stats.event_types[event_type];
+    event_stats.latencies_ns.push_back(duration_cast<nanoseconds>(steady_clock::now() - event_start_time).count());
+    event_stats.requests += stats.requests - event_start_requests;
+    event_stats.round_trips += stats.round_trips - event_start_round_trips;
+}
+
+// Queues the next recorded batch if the queue is empty. Returns false once the log is exhausted.
+static bool ReadBatch(bool blocking) {
+    if (!started) {
+        // From here on, resources get the ids the recording process allocated
+        started = true;
+        next_resource = header.next_resource + 1;
+    }
+    if (next_event < queue_end)
+        return true;
+    if (!can_read && !blocking)
+        return false;
+    if (next_event == events.size()) {
+        if (!finished) {
+            finished = true;
+            raise(SIGTERM);
+        }
+        return false;
+    }
+
+    can_read = false;
+    queue_end = std::min(events.size(), next_event + 1 + events[next_event].queued);
+    for (size_t i = next_event; i < queue_end; i++) {
+        events[i].event.xany.display = reinterpret_cast<Display*>(display);
+    }
+    display->qlen = queue_end - next_event;
+    return true;
+}
+
+static const XEvent& PopEvent() {
+    event_time_ns = events[next_event].time_ns;
+    const XEvent& e = events[next_event++].event;
+    display->qlen = queue_end - next_event;
+    return e;
+}
+
+Display* XOpenDisplay(const char* name) {
+    display = static_cast<PrivDisplay*>(calloc(1, sizeof(PrivDisplay)));
+    // Always readable, so the event loop never waits for the stub
+    display->fd = eventfd(1, EFD_CLOEXEC);
+    display->display_name = display_name;
+    display->default_screen = 0;
+    display->nscreens = 1;
+    display->screens = &screen;
+    display->min_keycode = kMinKeycode;
+    display->max_keycode = kMaxKeycode;
+
+    visual.visualid = 0x21;
+    visual.c_class = TrueColor;
+    visual.red_mask = 0xff0000;
+    visual.green_mask = 0xff00;
+    visual.blue_mask = 0xff;
+    visual.bits_per_rgb = 8;
+    visual.map_entries = 256;
+
+    screen.display = reinterpret_cast<Display*>(display);
+    screen.root = header.root;
+    screen.width = header.screen_width;
+    screen.height = header.screen_height;
+    screen.root_depth = 24;
+    screen.root_visual = &visual;
+    screen.cmap = 0x20;
+    screen.white_pixel = 0xffffff;
+    screen.black_pixel = 0;
+
+    StubWindow& root = windows[header.root];
+    root.parent = None;
+    root.width = header.screen_width;
+    root.height = header.screen_height;
+    root.mapped = true;
+    return reinterpret_cast<Display*>(display);
+}
+
+int XCloseDisplay(Display*) {
+    close(display->fd);
+    free(display);
+    display = nullptr;
+    return 0;
+}
+
+char* XDisplayName(const char*) {
+    return display_name;
+}
+
+char* XDisplayString(Display*) {
+    return display_name;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler) {
+    XErrorHandler previous = error_handler;
+    error_handler = handler;
+    return previous;
+}
+
+int XGetErrorText(Display*, int code, char* buffer, int length) {
+    snprintf(buffer, length, "error %d", code);
+    return 0;
+}
+
+int XEventsQueued(Display*, int mode) {
+    if (mode != QueuedAlready)
+        ReadBatch(false);
+    return display->qlen;
+}
+
+int XPeekEvent(Display*, XEvent* e) {
+    memset(e, 0, sizeof(*e));
+    if (ReadBatch(true))
+        *e = events[next_event].event;
+    peeked = true;
+    return 0;
+}
+
+int XNextEvent(Display*, XEvent* e) {
+    // Reading the event that was just peeked at continues the current event
+    if (!peeked)
+        EndEvent();
+    else if (in_event)
+        stats.event_types[event_type].coalesced++;
+    peeked = false;
+
+    memset(e, 0, sizeof(*e));
+    if (ReadBatch(true))
+        *e = PopEvent();
+    if (!in_event) {
+        in_event = true;
+        event_type = e->type;
+        event_start_time = steady_clock::now();
+        event_start_requests = stats.requests;
+        event_start_round_trips = stats.round_trips;
+    }
+    return 0;
+}
+
+int XFlush(Display*) {
+    EndEvent();
+    can_read = true;
+    stats.flushes++;
+    return 1;
+}
+
+int XSync(Display*, Bool) {
+    SendRequest(true);
+    return 1;
+}
+
+int XFree(void* data) {
+    free(data);
+    return 1;
+}
+
+static Atom InternAtom(const char* name) {
+    auto it = atoms.find(name);
+    if (it == atoms.end())
+        it = atoms.emplace(name, next_atom++).first;
+    return it->second;
+}
+
+Atom XInternAtom(Display*, const char* name, Bool) {
+    SendRequest(true);
+    return InternAtom(name);
+}
+
+// The requests share one round trip
+Status XInternAtoms(Display*, char** names, int count, Bool, Atom* atoms_return) {
+    for (int i = 0; i < count; i++) {
+        SendRequest(i == count - 1);
+        atoms_return[i] = InternAtom(names[i]);
+    }
+    return 1;
+}
+
+Status XAllocNamedColor(Display*, Colormap, const char* name, XColor* screen_def, XColor* exact_def) {
+    SendRequest(true);
+    XColor color = {0};
+    color.pixel = std::hash<string>()(name) & 0xffffff;
+    color.red = (color.pixel >> 16 & 0xff) * 0x101;
+    color.green = (color.pixel >> 8 & 0xff) * 0x101;
+    color.blue = (color.pixel & 0xff) * 0x101;
+    *screen_def = color;
+    *exact_def = color;
+    return 1;
+}
+
+Window XCreateWindow(Display*,
+                     Window parent,
+                     int x,
+                     int y,
+                     unsigned int width,
+                     unsigned int height,
+                     unsigned int border_width,
+                     int,
+                     unsigned int,
+                     Visual*,
+                     unsigned long,
+                     XSetWindowAttributes*) {
+    return CreateWindow(parent, x, y, width, height, border_width);
+}
+
+Window XCreateSimpleWindow(Display*,
+                           Window parent,
+                           int x,
+                           int y,
+                           unsigned int width,
+                           unsigned int height,
+                           unsigned int border_width,
+                           unsigned long,
+                           unsigned long) {
+    return CreateWindow(parent, x, y, width, height, border_width);
+}
+
+int XDestroyWindow(Display*, Window w) {
+    SendRequest(false);
+    windows.erase(w);
+    return 1;
+}
+
+int XMapWindow(Display*, Window w) {
+    SendRequest(false);
+    FindWindow(w).mapped = true;
+    return 1;
+}
+
+int XUnmapWindow(Display*, Window w) {
+    SendRequest(false);
+    FindWindow(w).mapped = false;
+    return 1;
+}
+
+int XReparentWindow(Display*, Window w, Window parent, int x, int y) {
+    SendRequest(false);
+    StubWindow& window = FindWindow(w);
+    window.parent = parent;
+    window.x = x;
+    window.y = y;
+    return 1;
+}
+
+int XMoveWindow(Display*, Window w, int x, int y) {
+    SendRequest(false);
+    StubWindow& window = FindWindow(w);
+    window.x = x;
+    window.y = y;
+    return 1;
+}
+
+int XResizeWindow(Display*, Window w, unsigned int width, unsigned int height) {
+    SendRequest(false);
+    StubWindow& window = FindWindow(w);
+    window.width = width;
+    window.height = height;
+    return 1;
+}
+
+int XMoveResizeWindow(Display*, Window w, int x, int y, unsigned int width, unsigned int height) {
+    SendRequest(false);
+    StubWindow& window = FindWindow(w);
+    window.x = x;
+    window.y = y;
+    window.width = width;
+    window.height = height;
+    return 1;
+}
+
+int XConfigureWindow(Display*, Window w, unsigned int value_mask, XWindowChanges* values) {
+    SendRequest(false);
+    StubWindow& window = FindWindow(w);
+    if (value_mask & CWX)
+        window.x = values->x;
+    if (value_mask & CWY)
+        window.y = values->y;
+    if (value_mask & CWWidth)
+        window.width = values->width;
+    if (value_mask & CWHeight)
+        window.height = values->height;
+    if (value_mask & CWBorderWidth)
+        window.border_width = values->border_width;
+    return 1;
+}
+
+int XSetWindowBorderWidth(Display*, Window w, unsigned int width) {
+    SendRequest(false);
+    FindWindow(w).border_width = width;
+    return 1;
+}
+
+Status XGetGeometry(Display*,
+                    Drawable d,
+                    Window* root,
+                    int* x,
+                    int* y,
+                    unsigned int* width,
+                    unsigned int* height,
+                    unsigned int* border_width,
+                    unsigned int* depth) {
+    SendRequest(true);
+    const StubWindow& window = FindWindow(d);
+    *root = header.root;
+    *x = window.x;
+    *y = window.y;
+    *width = window.width;
+    *height = window.height;
+    *border_width = window.border_width;
+    *depth = 24;
+    return 1;
+}
+
+Status XGetWindowAttributes(Display*, Window w, XWindowAttributes* attributes) {
+    SendRequest(true);
+    const StubWindow& window = FindWindow(w);
+    memset(attributes, 0, sizeof(*attributes));
+    attributes->x = window.x;
+    attributes->y = window.y;
+    attributes->width = window.width;
+    attributes->height = window.height;
+    attributes->border_width = window.border_width;
+    attributes->depth = 24;
+    attributes->visual = &visual;
+    attributes->root = header.root;
+    attributes->c_class = InputOutput;
+    attributes->map_state = window.mapped ? IsViewable : IsUnmapped;
+    attributes->screen = &screen;
+    return 1;
+}
+
+Status XQueryTree(Display*, Window, Window* root, Window* parent, Window** children, unsigned int* num_children) {
+    SendRequest(true);
+    *root = header.root;
+    *parent = None;
+    *children = nullptr;
+    *num_children = 0;
+    return 1;
+}
+
+int XGetWindowProperty(Display*,
+                       Window,
+                       Atom,
+                       long,
+                       long,
+                       Bool,
+                       Atom,
+                       Atom* type,
+                       int* format,
+                       unsigned long* num_items,
+                       unsigned long* bytes_after,
+                       unsigned char** data) {
+    SendRequest(true);
+    *type = None;
+    *format = 0;
+    *num_items = 0;
+    *bytes_after = 0;
+    *data = nullptr;
+    return Success;
+}
+
+int XChangeProperty(Display*, Window, Atom, Atom, int, int, const unsigned char*, int) {
+    SendRequest(false);
+    return 1;
+}
+
+int XDeleteProperty(Display*, Window, Atom) {
+    SendRequest(false);
+    return 1;
+}
+
+Status XSendEvent(Display*, Window, Bool, long, XEvent*) {
+    SendRequest(false);
+    return 1;
+}
+
+int XSelectInput(Display*, Window, long) {
+    SendRequest(false);
+    return 1;
+}
+
+int XAddToSaveSet(Display*, Window) {
+    SendRequest(false);
+    return 1;
+}
+
+int XRaiseWindow(Display*, Window) {
+    SendRequest(false);
+    return 1;
+}
+
+int XLowerWindow(Display*, Window) {
+    SendRequest(false);
+    return 1;
+}
+
+int XSetWindowBorder(Display*, Window, unsigned long) {
+    SendRequest(false);
+    return 1;
+}
+
+int XSetWindowBackgroundPixmap(Display*, Window, Pixmap) {
+    SendRequest(false);
+    return 1;
+}
+
+int XDefineCursor(Display*, Window, Cursor) {
+    SendRequest(false);
+    return 1;
+}
+
+int XSetCloseDownMode(Display*, int) {
+    SendRequest(false);
+    return 1;
+}
+
+int XGrabServer(Display*) {
+    SendRequest(false);
+    return 1;
+}
+
+int XUngrabServer(Display*) {
+    SendRequest(false);
+    return 1;
+}
+
+int XGrabKey(Display*, int, unsigned int, Window, Bool, int, int) {
+    SendRequest(false);
+    return 1;
+}
+
+int XUngrabKey(Display*, int, unsigned int, Window) {
+    SendRequest(false);
+    return 1;
+}
+
+int XGrabButton(Display*, unsigned int, unsigned int, Window, Bool, unsigned int, int, int, Window, Cursor) {
+    SendRequest(false);
+    return 1;
+}
+
+int XUngrabButton(Display*, unsigned int, unsigned int, Window) {
+    SendRequest(false);
+    return 1;
+}
+
+int XKillClient(Display*, XID) {
+    SendRequest(false);
+    return 1;
+}
+
+Font XLoadFont(Display*, const char*) {
+    SendRequest(false);
+    return AllocResource();
+}
+
+int XUnloadFont(Display*, Font) {
+    SendRequest(false);
+    return 1;
+}
+
+Cursor XCreateGlyphCursor(Display*, Font, Font, unsigned int, unsigned int, const XColor*, const XColor*) {
+    SendRequest(false);
+    return AllocResource();
+}
+
+int XFreeCursor(Display*, Cursor) {
+    SendRequest(false);
+    return 1;
+}
+
+Pixmap XCreatePixmap(Display*, Drawable, unsigned int, unsigned int, unsigned int) {
+    SendRequest(false);
+    return AllocResource();
+}
+
+int XFreePixmap(Display*, Pixmap) {
+    SendRequest(false);
+    return 1;
+}
+
+GC XCreateGC(Display*, Drawable, unsigned long, XGCValues*) {
+    SendRequest(false);
+    GC gc = new _XGC;
+    gc->gid = AllocResource();
+    return gc;
+}
+
+int XFreeGC(Display*, GC gc) {
+    SendRequest(false);
+    delete gc;
+    return 1;
+}
+
+GContext XGContextFromGC(GC gc) {
+    return gc->gid;
+}
+
+int XFillRectangle(Display*, Drawable, GC, int, int, unsigned int, unsigned int) {
+    SendRequest(false);
+    return 1;
+}
+
+int XDrawRectangle(Display*, Drawable, GC, int, int, unsigned int, unsigned int) {
+    SendRequest(false);
+    return 1;
+}
+
+int XDrawString(Display*, Drawable, GC, int, int, const char*, int) {
+    SendRequest(false);
+    return 1;
+}
+
+int XCopyArea(Display*, Drawable, Drawable, GC, int, int, unsigned int, unsigned int, int, int) {
+    SendRequest(false);
+    return 1;
+}
+
+// A fixed width font
+XFontStruct* XQueryFont(Display*, XID font) {
+    SendRequest(true);
+    XFontStruct* font_struct = static_cast<XFontStruct*>(calloc(1, sizeof(XFontStruct)));
+    font_struct->fid = font;
+    font_struct->min_char_or_byte2 = 0x20;
+    font_struct->max_char_or_byte2 = 0x7e;
+    font_struct->min_bounds.width = kFontWidth;
+    font_struct->max_bounds.width = kFontWidth;
+    font_struct->ascent = 11;
+    font_struct->descent = 2;
+    return font_struct;
+}
+
+int XFreeFontInfo(char**, XFontStruct* font_struct, int) {
+    free(font_struct);
+    return 1;
+}
+
+int XTextWidth(XFontStruct*, const char*, int count) {
+    return count * kFontWidth;
+}
+
+VisualID XVisualIDFromVisual(Visual* v) {
+    return v->visualid;
+}
+
+int XDisplayKeycodes(Display*, int* min_keycode, int* max_keycode) {
+    *min_keycode = kMinKeycode;
+    *max_keycode = kMaxKeycode;
+    return 1;
+}
+
+KeySym* XGetKeyboardMapping(Display*, KeyCode first_keycode, int count, int* keysyms_per_keycode) {
+    SendRequest(true);
+    KeySym* keysyms = static_cast<KeySym*>(calloc(count, sizeof(KeySym)));
+    for (int i = 0; i < count && first_keycode + i <= static_cast<int>(kMaxKeycode); i++) {
+        keysyms[i] = header.keysyms[first_keycode + i];
+    }
+    *keysyms_per_keycode = 1;
+    return keysyms;
+}
+
+KeyCode XKeysymToKeycode(Display*, KeySym keysym) {
+    for (unsigned int keycode = kMinKeycode; keycode <= kMaxKeycode; keycode++) {
+        if (keysym != NoSymbol && header.keysyms[keycode] == keysym)
+            return keycode;
+    }
+    return 0;
+}
+
+XModifierKeymap* XGetModifierMapping(Display*) {
+    SendRequest(true);
+    XModifierKeymap* modmap = static_cast<XModifierKeymap*>(malloc(sizeof(XModifierKeymap)));
+    modmap->max_keypermod = 4;
+    modmap->modifiermap = static_cast<KeyCode*>(malloc(sizeof(header.modifiers)));
+    memcpy(modmap->modifiermap, header.modifiers, sizeof(header.modifiers));
+    return modmap;
+}
+
+int XFreeModifiermap(XModifierKeymap* modmap) {
+    free(modmap->modifiermap);
+    free(modmap);
+    return 1;
+}
+
+int XRefreshKeyboardMapping(XMappingEvent*) {
+    return 1;
+}
+
+// The simulated server has no XSync extension, so resizes are only rate limited
+
+Status XSyncQueryExtension(Display*, int*, int*) {
+    SendRequest(true);
+    return 0;
+}
+
+Status XSyncInitialize(Display*, int*, int*) {
+    return 0;
+}
+
+Status XSyncQueryCounter(Display*, XSyncCounter, XSyncValue*) {
+    return 0;
+}
+
+XSyncAlarm XSyncCreateAlarm(Display*, unsigned long, XSyncAlarmAttributes*) {
+    return None;
+}
+
+Status XSyncChangeAlarm(Display*, XSyncAlarm, unsigned long, XSyncAlarmAttributes*) {
+    return 0;
+}
+
+Status XSyncDestroyAlarm(Display*, XSyncAlarm) {
+    return 0;
+}
+
+void XSyncIntToValue(XSyncValue* value, int i) {
+    value->lo = i;
+    value->hi = i < 0 ? -1 : 0;
+}
+
+void XSyncIntsToValue(XSyncValue* value, unsigned int lo, int hi) {
+    value->lo = lo;
+    value->hi = hi;
+}
+
+int XSyncValueHigh32(XSyncValue value) {
+    return value.hi;
+}
+
+unsigned int XSyncValueLow32(XSyncValue value) {
+    return value.lo;
+}
+
+Bool XSyncValueLessThan(XSyncValue a, XSyncValue b) {
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
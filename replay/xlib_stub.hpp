@@ -0,0 +1,43 @@
+#include <X11/Xlib.h>
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "../event_log.hpp"
+
+// In-process replacement for the parts of Xlib the window manager uses, linked into mswm_replay
+// instead of libX11. Events come from an event log and requests go nowhere: they are counted, and
+// the requests that need a reply get a simulated one from a table of the windows the window
+// manager configured. Windows the log only mentions in events are 640x480 at 0,0 until configured.
+// The simulated server has no properties, and no windows other than those created through the stub.
+//
+// XEventsQueued, XPeekEvent and XNextEvent read the recorded events in the batches they were
+// recorded in. A new batch becomes readable once the requests caused by the previous one have been
+// flushed. Once the log is exhausted, SIGTERM is raised to end the event loop. ReplayClock() stands
+// in for the steady clock, so drags are paced as they were when the log was recorded.
+
+struct ReplayEventStats {
+    // Time from reading each event until the next event is read or the requests are flushed, so it
+    // includes the once per batch work the event caused
+    std::vector<uint64_t> latencies_ns;
+    // Events the handler skipped over after peeking at them, such as compressed motion events
+    uint64_t coalesced = 0;
+    uint64_t requests = 0;
+    uint64_t round_trips = 0;
+};
+
+struct ReplayStats {
+    ReplayEventStats event_types[LASTEvent];
+    uint64_t requests = 0;
+    uint64_t round_trips = 0;
+    uint64_t flushes = 0;
+};
+
+// Serves events from a log to the next display opened
+void LoadReplay(const EventLogHeader& header, std::vector<RecordedEvent> events);
+const ReplayStats& GetReplayStats();
+// The recorded time of the event read last
+std::chrono::steady_clock::time_point ReplayClock();
@@ -0,0 +1,84 @@
+#include "snapshot.hpp"
+
+#include <unordered_set>
+
+using std::unordered_set;
+using std::vector;
+
+// Layout: magic, version, active workspace, active window, low and high half of the time, number of workspaces, number of clients, window and layout of every workspace, then
+// window, workspace, x, y, width and height of every client. Every value is 32 bits.
+static const unsigned long kSnapshotMagic = 0x4d57534d;  // "MSWM"
+static const unsigned long kSnapshotVersion = 3;
+static const size_t kHeaderLength = 8;
+static const size_t kWorkspaceRecordLength = 2;
+static const size_t kClientRecordLength = 6;
+
+vector<unsigned long> Snapshot::Encode() const {
+    vector<unsigned long> values = {
+        kSnapshotMagic,
+        kSnapshotVersion,
+        static_cast<unsigned long>(active_workspace),
+        active_window,
+        static_cast<uint32_t>(time_ns),
+        static_cast<uint32_t>(time_ns >> 32),
+        workspaces.size(),
+        clients.size(),
+    };
+    for (const WorkspaceRecord& w : workspaces) {
+        values.insert(values.end(), {w.window, static_cast<unsigned long>(w.layout)});
+    }
+    for (const ClientRecord& c : clients) {
+        values.insert(values.end(), {c.window,
+                                     static_cast<uint32_t>(c.workspace),
+                                     static_cast<uint32_t>(c.x),
+                                     static_cast<uint32_t>(c.y),
+                                     c.width,
+                                     c.height});
+    }
+    return values;
+}
+
+bool Snapshot::Decode(const vector<unsigned long>& values) {
+    if (values.size() < kHeaderLength || values[0] != kSnapshotMagic || values[1] != kSnapshotVersion)
+        return false;
+
+    const size_t num_workspaces = values[6];
+    const size_t num_clients = values[7];
+    if (num_workspaces == 0 ||
+        values.size() != kHeaderLength + num_workspaces * kWorkspaceRecordLength + num_clients * kClientRecordLength)
+        return false;
+
+    // Signed values were stored as their 32-bit two's complement
+    active_workspace = static_cast<int32_t>(values[2]);
+    active_window = values[3];
+    time_ns = (static_cast<uint64_t>(values[5]) << 32) | static_cast<uint32_t>(values[4]);
+    if (active_workspace < 0 || static_cast<size_t>(active_workspace) >= num_workspaces)
+        return false;
+
+    // The property may have been written by anyone, so windows must be unique for the registry
+    unordered_set<Window> windows;
+    auto it = values.begin() + kHeaderLength;
+    workspaces.clear();
+    for (size_t i = 0; i < num_workspaces; i++, it += kWorkspaceRecordLength) {
+        if (it[0] == None || !windows.insert(it[0]).second || it[1] >= static_cast<unsigned long>(Layout::kNumLayouts))
+            return false;
+        workspaces.push_back({it[0], static_cast<Layout>(it[1])});
+    }
+
+    clients.clear();
+    for (size_t i = 0; i < num_clients; i++, it += kClientRecordLength) {
+        const ClientRecord c = {
+            it[0],
+            static_cast<int32_t>(it[1]),
+            static_cast<int32_t>(it[2]),
+            static_cast<int32_t>(it[3]),
+            static_cast<unsigned int>(it[4]),
+            static_cast<unsigned int>(it[5]),
+        };
+        if (c.workspace < 0 || static_cast<size_t>(c.workspace) >= num_workspaces)
+            return false;
+        if (c.window != None && windows.insert(c.window).second)
+            clients.push_back(c);
+    }
+    return true;
+}
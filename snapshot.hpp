@@ -0,0 +1,37 @@
+#include <X11/Xlib.h>
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "layout.hpp"
+
+// Window manager state handed over to the new process on an in-place restart. It is stored as a
+// format 32 property on the root window, which outlives the X connection of the old process.
+struct Snapshot {
+    struct WorkspaceRecord {
+        Window window;
+        Layout layout;
+    };
+
+    struct ClientRecord {
+        Window window;
+        int workspace;
+        int x, y;
+        unsigned int width, height;
+    };
+
+    int active_workspace = 0;
+    Window active_window = None;
+    std::vector<WorkspaceRecord> workspaces;
+    std::vector<ClientRecord> clients;
+    // Steady clock time when the snapshot was taken, to measure the restart
+    uint64_t time_ns = 0;
+
+    // Property values, as passed to XChangeProperty with format 32
+    std::vector<unsigned long> Encode() const;
+    // Returns false if values aren't a valid snapshot of this version. Clients that are listed more
+    // than once, or are workspace windows, are skipped after their first record.
+    bool Decode(const std::vector<unsigned long>& values);
+};
@@ -0,0 +1,104 @@
+#include "stats.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <cstdio>
+
+#include "utils.hpp"
+
+using std::chrono::duration;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+void LatencyHistogram::Record(uint64_t value) {
+    counts_[BucketIndex(value)]++;
+    count_++;
+    if (value > max_)
+        max_ = value;
+}
+
+uint64_t LatencyHistogram::Percentile(double percentile) const {
+    if (count_ == 0)
+        return 0;
+
+    const uint64_t rank = static_cast<uint64_t>(percentile / 100 * (count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; i++) {
+        seen += counts_[i];
+        if (seen >= rank)
+            return std::min(BucketValue(i + 1) - 1, max_);
+    }
+    return max_;
+}
+
+int LatencyHistogram::BucketIndex(uint64_t value) {
+    // Values below kSubBuckets are exact. Above that, the bucket is the position of the highest
+    // bit followed by the next kSubBucketBits bits.
+    if (value < kSubBuckets)
+        return value;
+
+    const int msb = 63 - __builtin_clzll(value);
+    const int shift = msb - kSubBucketBits;
+    return (shift + 1) * kSubBuckets + ((value >> shift) & (kSubBuckets - 1));
+}
+
+uint64_t LatencyHistogram::BucketValue(int index) {
+    // Lowest value that falls into the bucket
+    if (index < kSubBuckets)
+        return index;
+
+    const int shift = index / kSubBuckets - 1;
+    return static_cast<uint64_t>(kSubBuckets + index % kSubBuckets) << shift;
+}
+
+EventStats::EventStats() : start_time_(steady_clock::now()) {}
+
+EventStats::Scope::Scope(EventStats* stats, Display* display, int event_type)
+    : stats_(stats),
+      display_(display),
+      event_type_(event_type),
+      start_request_(NextRequest(display)),
+      start_time_(steady_clock::now()) {}
+
+EventStats::Scope::~Scope() {
+    const uint64_t latency_ns = duration_cast<nanoseconds>(steady_clock::now() - start_time_).count();
+    stats_->Record(event_type_, latency_ns, NextRequest(display_) - start_request_);
+}
+
+void EventStats::Record(int event_type, uint64_t latency_ns, unsigned long requests) {
+    // Extension events are not tracked
+    if (event_type < 0 || event_type >= LASTEvent)
+        return;
+
+    event_types_[event_type].latency.Record(latency_ns);
+    event_types_[event_type].requests += requests;
+}
+
+void EventStats::Dump() const {
+    const double elapsed = duration<double>(steady_clock::now() - start_time_).count();
+    LOG(INFO) << "Event stats over " << elapsed << " s:";
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-18s %10s %10s %10s %10s %10s %10s",
+             "event", "count", "rate/s", "p50 us", "p99 us", "max us", "req/event");
+    LOG(INFO) << line;
+
+    for (int type = 0; type < LASTEvent; type++) {
+        const EventTypeStats& stats = event_types_[type];
+        const uint64_t count = stats.latency.count();
+        if (count == 0)
+            continue;
+
+        snprintf(line, sizeof(line), "%-18s %10llu %10.1f %10.1f %10.1f %10.1f %10.2f",
+                 XEventCodeToString(type).c_str(),
+                 static_cast<unsigned long long>(count),
+                 count / elapsed,
+                 stats.latency.Percentile(50) / 1000.0,
+                 stats.latency.Percentile(99) / 1000.0,
+                 stats.latency.max() / 1000.0,
+                 static_cast<double>(stats.requests) / count);
+        LOG(INFO) << line;
+    }
+}
@@ -0,0 +1,63 @@
+#include <X11/Xlib.h>
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Log-linear latency histogram in the style of HdrHistogram: every power of two is split into 16
+// linear sub-buckets, so recorded values keep about two significant digits. Recording is a few
+// instructions and the memory footprint is fixed.
+class LatencyHistogram {
+   public:
+    void Record(uint64_t value);
+    // Value at the given percentile (0 - 100), accurate to the bucket resolution
+    uint64_t Percentile(double percentile) const;
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+
+   private:
+    static const int kSubBucketBits = 4;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kNumBuckets = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketValue(int index);
+
+    uint64_t counts_[kNumBuckets] = {0};
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+};
+
+// Latency, rate and X request statistics for every event type handled by the WindowManager event
+// loop. Only compiled in with make STATS=1. The statistics are written to the log on SIGUSR1.
+class EventStats {
+   public:
+    EventStats();
+
+    // Times the handling of one event, from construction to destruction
+    class Scope {
+       public:
+        Scope(EventStats* stats, Display* display, int event_type);
+        ~Scope();
+
+       private:
+        EventStats* stats_;
+        Display* display_;
+        int event_type_;
+        unsigned long start_request_;
+        std::chrono::steady_clock::time_point start_time_;
+    };
+
+    void Record(int event_type, uint64_t latency_ns, unsigned long requests);
+    void Dump() const;
+
+   private:
+    struct EventTypeStats {
+        LatencyHistogram latency;
+        uint64_t requests = 0;
+    };
+
+    EventTypeStats event_types_[LASTEvent];
+    std::chrono::steady_clock::time_point start_time_;
+};
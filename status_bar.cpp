@@ -0,0 +1,173 @@
+#include "status_bar.hpp"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+#include "config.hpp"
+
+using std::max;
+using std::min;
+using std::string;
+
+// Text placement inside the bar
+static const int kTextX = 16;
+static const int kTextBaselineY = 16;
+
+// Bound on the number of cached text widths
+static const size_t kMaxCachedTextWidths = 1024;
+
+StatusBar::StatusBar(Display* display, Window parent, int num_segments, int first_right_segment)
+    : display_(display),
+      width_(DisplayWidth(display, DefaultScreen(display))),
+      height_(STATUS_BAR_HEIGHT),
+      segments_(num_segments),
+      first_right_segment_(first_right_segment) {
+    window_ = XCreateSimpleWindow(display_,
+                                  parent,
+                                  0, 0,
+                                  width_, height_,
+                                  STATUS_BAR_BORDER_WIDTH,
+                                  STATUS_BAR_BORDER_COLOR,
+                                  STATUS_BAR_BG_COLOR);
+
+    // Exposed areas are repaired from the pixmap, so don't let the server clear them first
+    XSetWindowBackgroundPixmap(display_, window_, None);
+    XSelectInput(display_, window_, ExposureMask);
+
+    pixmap_ = XCreatePixmap(display_, window_, width_, height_, DefaultDepth(display_, DefaultScreen(display_)));
+
+    XGCValues values;
+    values.foreground = STATUS_BAR_BG_COLOR;
+    bg_gc_ = XCreateGC(display_, pixmap_, GCForeground, &values);
+    values.foreground = BlackPixel(display_, DefaultScreen(display_));
+    gc_ = XCreateGC(display_, pixmap_, GCForeground, &values);
+
+    XFillRectangle(display_, pixmap_, bg_gc_, 0, 0, width_, height_);
+
+    // Metrics of the default font, used to measure text without a round trip
+    font_ = CHECK_NOTNULL(XQueryFont(display_, XGContextFromGC(gc_)));
+    space_width_ = TextWidth(" ");
+
+    XMapWindow(display_, window_);
+}
+
+StatusBar::~StatusBar() {
+    XFreeFontInfo(nullptr, font_, 1);
+    XFreeGC(display_, gc_);
+    XFreeGC(display_, bg_gc_);
+    XFreePixmap(display_, pixmap_);
+    XDestroyWindow(display_, window_);
+}
+
+void StatusBar::SetSegment(int segment, const string& text) {
+    if (segments_[segment].text == text)
+        return;
+
+    segments_[segment].text = text;
+    dirty_ = true;
+}
+
+void StatusBar::Draw() {
+    if (!dirty_)
+        return;
+    dirty_ = false;
+
+    Layout();
+
+    // Re-render every run of segments whose text or position changed and copy each to the window,
+    // so that a segment updating on its own doesn't repaint the others. Segments are laid out left
+    // to right, so the runs come in order.
+    int begin = 0;
+    int end = 0;
+    for (const Segment& s : segments_) {
+        if (s.shown_text == s.drawn_text && s.x == s.drawn_x)
+            continue;
+
+        const int s_begin = min(s.x, s.drawn_x);
+        const int s_end = max(s.x + s.width, s.drawn_x + s.drawn_width);
+        if (s_begin > end) {
+            DrawSpan(begin, end);
+            begin = s_begin;
+        }
+        end = max(end, s_end);
+    }
+    DrawSpan(begin, end);
+
+    for (Segment& s : segments_) {
+        s.drawn_text = s.shown_text;
+        s.drawn_x = s.x;
+        s.drawn_width = s.width;
+    }
+}
+
+void StatusBar::DrawSpan(int begin, int end) {
+    if (begin >= end)
+        return;
+
+    XFillRectangle(display_, pixmap_, bg_gc_, begin, 0, end - begin, height_);
+    for (const Segment& s : segments_) {
+        if (!s.shown_text.empty() && s.x < end && s.x + s.width > begin)
+            XDrawString(display_, pixmap_, gc_, s.x, kTextBaselineY, s.shown_text.c_str(), s.shown_text.length());
+    }
+    XCopyArea(display_, pixmap_, window_, gc_, begin, 0, end - begin, height_, begin, 0);
+}
+
+void StatusBar::OnExpose(const XExposeEvent& e) {
+    XCopyArea(display_, pixmap_, window_, gc_, e.x, e.y, e.width, e.height, e.x, e.y);
+}
+
+int StatusBar::TextWidth(const string& text) {
+    auto it = text_widths_.find(text);
+    if (it != text_widths_.end())
+        return it->second;
+
+    if (text_widths_.size() >= kMaxCachedTextWidths)
+        text_widths_.clear();
+
+    const int width = XTextWidth(font_, text.c_str(), text.length());
+    text_widths_[text] = width;
+    return width;
+}
+
+string StatusBar::Truncate(const string& text, int width) {
+    if (TextWidth(text) <= width)
+        return text;
+
+    // Core fonts have no kerning, so the width of a prefix is the sum of its characters' widths
+    const int ellipsis_width = TextWidth("...");
+    int prefix_width = 0;
+    size_t length = 0;
+    while (length < text.length()) {
+        const int char_width = XTextWidth(font_, &text[length], 1);
+        if (prefix_width + char_width + ellipsis_width > width)
+            break;
+        prefix_width += char_width;
+        length++;
+    }
+    return ellipsis_width <= width ? text.substr(0, length) + "..." : "";
+}
+
+void StatusBar::Layout() {
+    // Right-aligned segments first, from the right edge. Non-empty segments are separated by a
+    // space.
+    int right = width_ - kTextX;
+    for (int i = segments_.size() - 1; i >= first_right_segment_; i--) {
+        Segment& s = segments_[i];
+        s.shown_text = s.text;
+        s.width = TextWidth(s.text);
+        if (s.width > 0)
+            right -= s.width + space_width_;
+        s.x = right + space_width_;
+    }
+
+    int x = kTextX;
+    for (int i = 0; i < first_right_segment_; i++) {
+        Segment& s = segments_[i];
+        s.shown_text = Truncate(s.text, max(right - x, 0));
+        s.x = x;
+        s.width = TextWidth(s.shown_text);
+        if (s.width > 0)
+            x += s.width + space_width_;
+    }
+}
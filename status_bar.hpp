@@ -0,0 +1,62 @@
+#include <X11/Xlib.h>
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Status bar made of text segments. The segments before first_right_segment are laid out from the
+// left edge and the others are right-aligned, so that text changing on one side doesn't move the
+// other. Left segments are cut to the space left of the right-aligned ones. The bar is rendered
+// into an offscreen pixmap: only segments that changed are re-rendered, and each changed region is
+// copied to the window in a single blit. Exposures are repaired from the pixmap without
+// re-rendering.
+class StatusBar {
+   public:
+    StatusBar(Display* display, Window parent, int num_segments, int first_right_segment);
+    ~StatusBar();
+
+    Window window() const { return window_; }
+
+    void SetSegment(int segment, const std::string& text);
+    // Renders and copies the changed region to the window. Does nothing if nothing changed.
+    void Draw();
+    void OnExpose(const XExposeEvent& e);
+
+   private:
+    struct Segment {
+        std::string text;
+        // Text as laid out, which may be cut to fit
+        std::string shown_text;
+        int x = 0;
+        int width = 0;
+
+        // What is currently in the pixmap
+        std::string drawn_text;
+        int drawn_x = 0;
+        int drawn_width = 0;
+    };
+
+    int TextWidth(const std::string& text);
+    // Longest prefix of text that fits into width, followed by an ellipsis if it was cut
+    std::string Truncate(const std::string& text, int width);
+    void Layout();
+    // Re-renders the pixmap between two x coordinates and copies it to the window
+    void DrawSpan(int begin, int end);
+
+    Display* display_;
+    Window window_;
+    Pixmap pixmap_;
+    GC gc_;
+    GC bg_gc_;
+    XFontStruct* font_;
+    int space_width_;
+    int width_;
+    int height_;
+
+    std::vector<Segment> segments_;
+    int first_right_segment_;
+    bool dirty_ = false;
+    std::unordered_map<std::string, int> text_widths_;
+};
@@ -0,0 +1,163 @@
+#include "status_providers.hpp"
+
+#include <glog/logging.h>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+
+using std::string;
+using std::unique_ptr;
+using std::chrono::milliseconds;
+
+StatusProviders::StatusProviders(UpdateHandler handler) : handler_(std::move(handler)) {
+    event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    PCHECK(event_fd_ >= 0) << "Failed to create eventfd";
+}
+
+StatusProviders::~StatusProviders() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    stop_condition_.notify_all();
+    for (const unique_ptr<Worker>& worker : workers_) {
+        worker->thread.join();
+        delete worker->pending.load();
+    }
+    close(event_fd_);
+}
+
+void StatusProviders::Add(int segment, milliseconds interval, Provider provider) {
+    Worker* worker = new Worker();
+    worker->segment = segment;
+    worker->interval = interval;
+    worker->provider = std::move(provider);
+    workers_.emplace_back(worker);
+    worker->thread = std::thread(&StatusProviders::RunWorker, this, worker);
+}
+
+void StatusProviders::Dispatch() {
+    uint64_t count;
+    if (read(event_fd_, &count, sizeof(count)) != sizeof(count))
+        return;
+
+    for (const unique_ptr<Worker>& worker : workers_) {
+        unique_ptr<const string> text(worker->pending.exchange(nullptr));
+        if (text)
+            handler_(worker->segment, *text);
+    }
+}
+
+void StatusProviders::RunWorker(Worker* worker) {
+    string published;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        lock.unlock();
+        const string text = worker->provider();
+        if (text != published) {
+            published = text;
+            // A snapshot the event loop hasn't taken yet is superseded
+            delete worker->pending.exchange(new string(text));
+            const uint64_t one = 1;
+            PCHECK(write(event_fd_, &one, sizeof(one)) == sizeof(one));
+        }
+        lock.lock();
+        stop_condition_.wait_for(lock, worker->interval, [this] { return stopping_; });
+    }
+}
+
+// First line of a file without the newline, or an empty string if it can't be read
+static string ReadLine(const string& path) {
+    FILE* file = fopen(path.c_str(), "re");
+    if (file == nullptr)
+        return "";
+
+    char line[256] = "";
+    if (fgets(line, sizeof(line), file) == nullptr)
+        line[0] = '\0';
+    fclose(file);
+    string result(line);
+    if (!result.empty() && result.back() == '\n')
+        result.pop_back();
+    return result;
+}
+
+StatusProviders::Provider ClockProvider(const string& format) {
+    return [format]() {
+        const time_t now = time(nullptr);
+        tm local;
+        char text[64];
+        if (localtime_r(&now, &local) == nullptr || strftime(text, sizeof(text), format.c_str(), &local) == 0)
+            return string();
+        return string(text);
+    };
+}
+
+StatusProviders::Provider CpuProvider() {
+    uint64_t last_busy = 0;
+    uint64_t last_total = 0;
+    return [last_busy, last_total]() mutable {
+        // Aggregate jiffies: user nice system idle iowait irq softirq steal
+        uint64_t t[8];
+        FILE* file = fopen("/proc/stat", "re");
+        if (file == nullptr)
+            return string();
+        const int n = fscanf(file, "cpu %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                                   " %" SCNu64 " %" SCNu64,
+                             &t[0], &t[1], &t[2], &t[3], &t[4], &t[5], &t[6], &t[7]);
+        fclose(file);
+        if (n != 8)
+            return string();
+
+        const uint64_t total = t[0] + t[1] + t[2] + t[3] + t[4] + t[5] + t[6] + t[7];
+        const uint64_t busy = total - t[3] - t[4];
+        const uint64_t elapsed = total - last_total;
+        const uint64_t percent = elapsed > 0 ? 100 * (busy - last_busy) / elapsed : 0;
+        last_busy = busy;
+        last_total = total;
+        return "cpu " + std::to_string(percent) + "%";
+    };
+}
+
+StatusProviders::Provider MemoryProvider() {
+    return []() {
+        FILE* file = fopen("/proc/meminfo", "re");
+        if (file == nullptr)
+            return string();
+        uint64_t total = 0;
+        uint64_t available = 0;
+        char line[256];
+        while (fgets(line, sizeof(line), file) != nullptr) {
+            sscanf(line, "MemTotal: %" SCNu64, &total);
+            sscanf(line, "MemAvailable: %" SCNu64, &available);
+        }
+        fclose(file);
+        if (total == 0)
+            return string();
+        return "mem " + std::to_string(100 * (total - available) / total) + "%";
+    };
+}
+
+StatusProviders::Provider LoadProvider() {
+    return []() {
+        const string loadavg = ReadLine("/proc/loadavg");
+        const size_t end = loadavg.find(' ');
+        if (end == string::npos)
+            return string();
+        return "load " + loadavg.substr(0, end);
+    };
+}
+
+StatusProviders::Provider BatteryProvider(const string& name) {
+    const string path = "/sys/class/power_supply/" + name + "/";
+    return [path]() {
+        const string capacity = ReadLine(path + "capacity");
+        if (capacity.empty())
+            return string();
+        return "bat " + capacity + "%" + (ReadLine(path + "status") == "Charging" ? "+" : "");
+    };
+}
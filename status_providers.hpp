@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Status bar segments that show system state. Every provider runs on its own worker thread, which
+// calls it at the provider's interval, so reading /proc never delays the event loop. A changed
+// text is published as an immutable snapshot in a single-slot mailbox that is swapped atomically,
+// and the worker signals an eventfd. When the fd, which the caller's event loop polls, becomes
+// readable, Dispatch() hands the latest text of every changed provider to the update handler.
+class StatusProviders {
+   public:
+    // Computes the text of a segment, called on the worker thread only
+    using Provider = std::function<std::string()>;
+    using UpdateHandler = std::function<void(int segment, const std::string& text)>;
+
+    explicit StatusProviders(UpdateHandler handler);
+    // Stops and joins the workers
+    ~StatusProviders();
+
+    // Starts a worker that calls provider every interval
+    void Add(int segment, std::chrono::milliseconds interval, Provider provider);
+    int fd() const { return event_fd_; }
+    void Dispatch();
+
+   private:
+    struct Worker {
+        int segment;
+        std::chrono::milliseconds interval;
+        Provider provider;
+        // Latest text not yet dispatched, owned by whoever swaps it out
+        std::atomic<const std::string*> pending{nullptr};
+        std::thread thread;
+    };
+
+    void RunWorker(Worker* worker);
+
+    UpdateHandler handler_;
+    int event_fd_ = -1;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    // Wakes the workers early on shutdown
+    std::mutex mutex_;
+    std::condition_variable stop_condition_;
+    bool stopping_ = false;
+};
+
+// Built-in providers. They return an empty text, which hides the segment, if their source is
+// unavailable.
+
+// Local time formatted with strftime
+StatusProviders::Provider ClockProvider(const std::string& format);
+// CPU usage since the previous call, from /proc/stat
+StatusProviders::Provider CpuProvider();
+// Share of memory in use, from /proc/meminfo
+StatusProviders::Provider MemoryProvider();
+// One minute load average, from /proc/loadavg
+StatusProviders::Provider LoadProvider();
+// Charge of a battery in /sys/class/power_supply, with a "+" while charging
+StatusProviders::Provider BatteryProvider(const std::string& name);
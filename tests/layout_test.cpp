@@ -0,0 +1,89 @@
+// Checks that adding a client to a tiled layout reconfigures only a few of the existing clients.
+// Run with make test.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "../layout.hpp"
+
+using std::vector;
+
+static const Rect kArea = {0, 26, 1920, 1054};
+static const size_t kMaxClients = 200;
+
+static int failures = 0;
+
+// Existing clients whose rectangle changes when client n is added
+static size_t CountChanged(Layout layout, size_t n) {
+    vector<Rect> before(n);
+    vector<Rect> after(n + 1);
+    ComputeLayout(layout, n, kArea, before.data());
+    ComputeLayout(layout, n + 1, kArea, after.data());
+    size_t changed = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (before[i] != after[i])
+            changed++;
+    }
+    return changed;
+}
+
+static size_t Lines(size_t n) {
+    return static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(n))));
+}
+
+static void Expect(bool condition, const char* layout, size_t n, size_t changed) {
+    if (condition)
+        return;
+    fprintf(stderr, "%s: adding client %zu changed %zu rectangles\n", layout, n + 1, changed);
+    failures++;
+}
+
+// Every cell lies in the area and the cells don't overlap
+static void CheckCover(Layout layout, const char* name, size_t n) {
+    vector<Rect> rects(n);
+    ComputeLayout(layout, n, kArea, rects.data());
+    unsigned long covered = 0;
+    for (size_t i = 0; i < n; i++) {
+        const Rect& r = rects[i];
+        covered += static_cast<unsigned long>(r.width) * r.height;
+        if (r.x < kArea.x || r.y < kArea.y || r.x + r.width > kArea.x + kArea.width ||
+            r.y + r.height > kArea.y + kArea.height) {
+            fprintf(stderr, "%s: cell %zu of %zu is outside the area\n", name, i, n);
+            failures++;
+        }
+    }
+    if (covered != static_cast<unsigned long>(kArea.width) * kArea.height) {
+        fprintf(stderr, "%s: %zu cells don't tile the area\n", name, n);
+        failures++;
+    }
+}
+
+int main() {
+    // The case the layouts were written for: a 31st window in a workspace of 30
+    const size_t grid_changed = CountChanged(Layout::kGrid, 30);
+    const size_t stack_changed = CountChanged(Layout::kMasterStack, 30);
+    printf("30 -> 31 clients: grid changed %zu, master/stack changed %zu\n", grid_changed, stack_changed);
+    Expect(grid_changed <= 5, "grid", 30, grid_changed);
+    Expect(stack_changed <= 5, "master/stack", 30, stack_changed);
+
+    // Only the column or row the new client joins changes, unless the number of lines changes
+    for (size_t n = 1; n < kMaxClients; n++) {
+        const size_t grid = CountChanged(Layout::kGrid, n);
+        Expect(Lines(n + 1) != Lines(n) || grid <= (n + Lines(n) - 1) / Lines(n), "grid", n, grid);
+
+        // The master changes only when the stack appears
+        const size_t stack = CountChanged(Layout::kMasterStack, n);
+        Expect(n == 1 || Lines(n) != Lines(n - 1) || stack <= (n - 1 + Lines(n) - 1) / Lines(n),
+               "master/stack", n, stack);
+
+        CheckCover(Layout::kGrid, "grid", n);
+        CheckCover(Layout::kMasterStack, "master/stack", n);
+    }
+
+    if (failures > 0)
+        return EXIT_FAILURE;
+    printf("ok\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+#include "trace.hpp"
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+// Number of records kept, a power of two
+static const uint64_t kTraceCapacity = 1 << 16;
+
+static TraceRecord ring[kTraceCapacity];
+// Total number of records written. The record is stored before the count is published, so a dump
+// from a signal handler sees complete records.
+static std::atomic<uint64_t> num_written(0);
+static char trace_path[256];
+
+static void OnFatalSignal(int signal) {
+    TraceDump();
+    // The default action was restored when the handler was entered
+    raise(signal);
+}
+
+void TraceInit(const std::string& path) {
+    snprintf(trace_path, sizeof(trace_path), "%s", path.c_str());
+
+    struct sigaction action = {};
+    action.sa_handler = &OnFatalSignal;
+    action.sa_flags = SA_RESETHAND;
+    for (int signal : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+        sigaction(signal, &action, nullptr);
+    }
+}
+
+void Trace(TracePoint point, int code, unsigned long window, uint32_t arg) {
+    const uint64_t i = num_written.load(std::memory_order_relaxed);
+    TraceRecord& record = ring[i & (kTraceCapacity - 1)];
+    record.time_ns = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    record.window = window;
+    record.arg = arg;
+    record.point = point;
+    record.code = code;
+    num_written.store(i + 1, std::memory_order_release);
+}
+
+static bool WriteAll(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        const ssize_t n = write(fd, p, size);
+        if (n < 0)
+            return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool TraceDump() {
+    if (trace_path[0] == '\0')
+        return false;
+
+    const int fd = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return false;
+
+    // The oldest record is at the write position once the ring has wrapped
+    const uint64_t end = num_written.load(std::memory_order_acquire);
+    const uint64_t count = std::min(end, kTraceCapacity);
+    const uint64_t first = (end - count) & (kTraceCapacity - 1);
+    const uint64_t head = std::min(count, kTraceCapacity - first);
+
+    const TraceFileHeader header = {kTraceMagic, kTraceVersion, count};
+    const bool ok = WriteAll(fd, &header, sizeof(header)) &&
+                    WriteAll(fd, ring + first, head * sizeof(TraceRecord)) &&
+                    WriteAll(fd, ring, (count - head) * sizeof(TraceRecord));
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+// Binary trace of what the event loop handled, kept in a fixed-size ring in memory. Recording a
+// point stores one TraceRecord without allocating or formatting. The ring is written to the trace
+// file on SIGUSR2 and when mswm crashes, and mswmtrace decodes that file to text.
+
+enum TracePoint : uint16_t {
+    kTraceEvent,         // code = event type
+    kTraceIgnoredEvent,  // code = event type
+    kTraceXError,        // code = request code, arg = error code
+    kTraceMapWindow,
+    kTraceDeleteWindow,
+    kTraceKillWindow,
+    kNumTracePoints,
+};
+
+struct TraceRecord {
+    uint64_t time_ns;  // steady clock
+    uint32_t window;
+    uint32_t arg;
+    uint16_t point;
+    uint16_t code;
+    uint32_t reserved;
+};
+
+// The trace file is a TraceFileHeader followed by num_records TraceRecords, oldest first
+struct TraceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t num_records;
+};
+
+const uint32_t kTraceMagic = 0x5457534d;  // "MSWT"
+const uint32_t kTraceVersion = 1;
+
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord must be packed");
+static_assert(sizeof(TraceFileHeader) == 16, "TraceFileHeader must be packed");
+
+inline const char* TracePointName(int point) {
+    static const char* const TRACE_POINT_NAMES[] = {
+        "Event",
+        "IgnoredEvent",
+        "XError",
+        "MapWindow",
+        "DeleteWindow",
+        "KillWindow",
+    };
+    return point >= 0 && point < kNumTracePoints ? TRACE_POINT_NAMES[point] : "Unknown";
+}
+
+// Trace file path for a display, overridable with $MSWM_TRACE
+inline std::string TracePath(const std::string& display_name) {
+    if (const char* path = getenv("MSWM_TRACE"))
+        return path;
+    return "/tmp/mswm-" + std::to_string(getuid()) + "-" + display_name + ".trace";
+}
+
+// Sets the trace file and dumps the ring to it when a fatal signal is received
+void TraceInit(const std::string& path);
+// Records a point. Must only be called from the event loop thread.
+void Trace(TracePoint point, int code, unsigned long window, uint32_t arg = 0);
+// Writes the ring to the trace file. Async-signal-safe.
+bool TraceDump();
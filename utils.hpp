@@ -2,7 +2,7 @@
 
 using std::string;
 
-string XEventCodeToString(int event_code) {
+inline string XEventCodeToString(int event_code) {
     static const char* const X_EVENT_TYPE_NAMES[] = {
         "",
         "",
@@ -44,7 +44,8 @@ string XEventCodeToString(int event_code) {
     return X_EVENT_TYPE_NAMES[event_code];
 }
 
-string XRequestCodeToString(unsigned char request_code) {
+// Name of a core request, or the number of an extension request, whose major opcodes are 128 and up
+inline string XRequestCodeToString(unsigned char request_code) {
     static const char* const X_REQUEST_CODE_NAMES[] = {
         "",
         "CreateWindow",
@@ -166,7 +167,17 @@ string XRequestCodeToString(unsigned char request_code) {
         "GetPointerMapping",
         "SetModifierMapping",
         "GetModifierMapping",
+        "",
+        "",
+        "",
+        "",
+        "",
+        "",
+        "",
         "NoOperation",
     };
+    if (request_code >= sizeof(X_REQUEST_CODE_NAMES) / sizeof(X_REQUEST_CODE_NAMES[0]) ||
+        X_REQUEST_CODE_NAMES[request_code][0] == '\0')
+        return std::to_string(request_code);
     return X_REQUEST_CODE_NAMES[request_code];
 }
\ No newline at end of file
@@ -1,23 +1,86 @@
 #include "window_manager.hpp"
 
+#include <X11/Xatom.h>
 #include <X11/Xutil.h>
 #include <X11/cursorfont.h>
 #include <glog/logging.h>
 
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <csignal>
+#include <cstdlib>
 
 #include "config.hpp"
+#include "control_protocol.hpp"
+#include "event_log.hpp"
+#include "launcher.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 
 using std::find;
 using std::max;
+using std::min;
 using std::pair;
 using std::string;
 using std::unique_ptr;
 using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
 
 bool WindowManager::wm_detected_;
 
+// Taken during static initialization, right after exec
+static const steady_clock::time_point kExecTime = steady_clock::now();
+
+// Modifiers that are significant for key bindings. Lock modifiers are masked out at runtime.
+static const unsigned int kModifierMask = ShiftMask | ControlMask | Mod1Mask | Mod2Mask | Mod3Mask | Mod4Mask | Mod5Mask;
+
+const pair<Atom WindowManager::*, const char*> WindowManager::kAtoms[] = {
+    {&WindowManager::WM_PROTOCOLS, "WM_PROTOCOLS"},
+    {&WindowManager::WM_DELETE_WINDOW, "WM_DELETE_WINDOW"},
+    {&WindowManager::NET_WM_NAME, "_NET_WM_NAME"},
+    {&WindowManager::MSWM_STATE, "_MSWM_STATE"},
+    {&WindowManager::NET_WM_SYNC_REQUEST, "_NET_WM_SYNC_REQUEST"},
+    {&WindowManager::NET_WM_SYNC_REQUEST_COUNTER, "_NET_WM_SYNC_REQUEST_COUNTER"},
+    {&WindowManager::NET_SUPPORTED, "_NET_SUPPORTED"},
+    {&WindowManager::NET_SUPPORTING_WM_CHECK, "_NET_SUPPORTING_WM_CHECK"},
+    {&WindowManager::NET_CLIENT_LIST, "_NET_CLIENT_LIST"},
+    {&WindowManager::NET_ACTIVE_WINDOW, "_NET_ACTIVE_WINDOW"},
+    {&WindowManager::NET_CURRENT_DESKTOP, "_NET_CURRENT_DESKTOP"},
+    {&WindowManager::NET_NUMBER_OF_DESKTOPS, "_NET_NUMBER_OF_DESKTOPS"},
+    {&WindowManager::UTF8_STRING, "UTF8_STRING"},
+};
+
+const WindowManager::KeyBinding WindowManager::kKeyBindings[] = {
+    // Alt + Tab to switch active window
+    {Mod1Mask, XK_Tab, &WindowManager::FocusNextClient, 0},
+    // Alt + Shift + Enter for terminal
+    {Mod1Mask | ShiftMask, XK_Return, &WindowManager::SpawnTerminal, 0},
+    // Alt + Ctrl + Right/Left for next/previous workspace
+    {Mod1Mask | ControlMask, XK_Right, &WindowManager::ShiftWorkspace, 1},
+    {Mod1Mask | ControlMask, XK_Left, &WindowManager::ShiftWorkspace, -1},
+    // Alt + Shift + Ctrl + Right/Left to move active window to next/previous workspace
+    {Mod1Mask | ControlMask | ShiftMask, XK_Right, &WindowManager::MoveActiveClient, 1},
+    {Mod1Mask | ControlMask | ShiftMask, XK_Left, &WindowManager::MoveActiveClient, -1},
+    // Alt + Space to cycle the layout of the active workspace
+    {Mod1Mask, XK_space, &WindowManager::CycleLayout, 0},
+    // Alt + Shift + R to restart in place
+    {Mod1Mask | ShiftMask, XK_r, &WindowManager::Restart, 0},
+};
+
+static unsigned int KeyMapIndex(unsigned int keycode, unsigned int modifiers) {
+    return keycode << 16 | modifiers;
+}
+
 unique_ptr<WindowManager> WindowManager::Create() {
     Display* display = XOpenDisplay(nullptr);
     if (display == nullptr) {
@@ -29,165 +92,337 @@ unique_ptr<WindowManager> WindowManager::Create() {
 
 WindowManager::WindowManager(Display* display) : display_(CHECK_NOTNULL(display)),
                                                  root_(DefaultRootWindow(display_)),
-                                                 WM_PROTOCOLS(XInternAtom(display_, "WM_PROTOCOLS", false)),
-                                                 WM_DELETE_WINDOW(XInternAtom(display_, "WM_DELETE_WINDOW", false)) {
+                                                 backend_(display_) {
+    // Intern every atom in a single round trip
+    const int num_atoms = sizeof(kAtoms) / sizeof(kAtoms[0]);
+    char* names[num_atoms];
+    Atom values[num_atoms];
+    for (int i = 0; i < num_atoms; i++) {
+        names[i] = const_cast<char*>(kAtoms[i].second);
+    }
+    CHECK(XInternAtoms(display_, names, num_atoms, false, values));
+    for (int i = 0; i < num_atoms; i++) {
+        this->*kAtoms[i].first = values[i];
+    }
 }
 
 WindowManager::~WindowManager() {
+    // Hand the clients back to the root window. On disconnect the save-set would do this, but not
+    // out of workspace windows that were inherited from a restart.
+    for (int workspace = 0; workspace < clients_.NumWorkspaces(); workspace++) {
+        clients_.ForEachClient(workspace, [this](Client* c) {
+            XReparentWindow(display_, c->window, root_, c->x, c->y);
+        });
+    }
+
+    // The check window goes away with the status bar
+    if (!wm_detected_)
+        XDeleteProperty(display_, root_, NET_SUPPORTING_WM_CHECK);
+#ifdef MSWM_COMPOSITOR
+    compositor_.reset();
+#endif
+    // The workers publish into the status bar
+    status_providers_.reset();
+    status_bar_.reset();
+    control_server_.reset();
+    for (int fd : {epoll_fd_, timer_fd_, signal_fd_}) {
+        if (fd >= 0)
+            close(fd);
+    }
     XCloseDisplay(display_);
 }
 
 void WindowManager::Run() {
-    // Initialization
+    // Initialization. Apart from the keyboard mapping lookups in GrabKeys(), the setup up to the
+    // status bar is sent without waiting for replies. Xlib handles the errors of earlier requests
+    // before it returns a reply, so the status bar's font query doubles as the one sync that
+    // reports a BadAccess from another window manager holding the redirect or our key grabs.
     wm_detected_ = false;
     XSetErrorHandler(&WindowManager::OnWMDetected);
 
-    // Alt + Mouse buttons
-    XGrabButton(display_,
-                AnyButton,
-                Mod1Mask,
-                root_,
-                True,
-                ButtonPressMask | ButtonReleaseMask | PointerMotionMask | OwnerGrabButtonMask,
-                GrabModeAsync,
-                GrabModeAsync,
-                None,
-                None);
+    XSelectInput(display_, root_, SubstructureNotifyMask | SubstructureRedirectMask);
 
-    // Alt + Tab to switch active window
-    XGrabKey(display_,
-             XKeysymToKeycode(display_, XK_Tab),
-             Mod1Mask,
-             root_,
-             False,
-             GrabModeAsync,
-             GrabModeAsync);
-
-    // Alt + (Shift) + Enter for Terminal
-    XGrabKey(display_,
-             XKeysymToKeycode(display_, XK_Return),
-             Mod1Mask | ShiftMask,
-             root_,
-             False,
-             GrabModeAsync,
-             GrabModeAsync);
-
-    // Alt + Ctrl + Right for next workspace
-    XGrabKey(display_,
-             XKeysymToKeycode(display_, XK_Right),
-             Mod1Mask | ControlMask,
-             root_,
-             False,
-             GrabModeAsync,
-             GrabModeAsync);
-
-    // Alt + Ctrl + Left for previous workspace
-    XGrabKey(display_,
-             XKeysymToKeycode(display_, XK_Left),
-             Mod1Mask | ControlMask,
-             root_,
-             False,
-             GrabModeAsync,
-             GrabModeAsync);
-
-    // Alt + Shift + Ctrl + Right to move active window to next workpace
-    XGrabKey(display_,
-             XKeysymToKeycode(display_, XK_Right),
-             Mod1Mask | ControlMask | ShiftMask,
-             root_,
-             False,
-             GrabModeAsync,
-             GrabModeAsync);
-
-    // Alt + Shift + Ctrl + Left to move active window to previous workpace
-    XGrabKey(display_,
-             XKeysymToKeycode(display_, XK_Left),
-             Mod1Mask | ControlMask | ShiftMask,
-             root_,
-             False,
-             GrabModeAsync,
-             GrabModeAsync);
+    GrabKeys();
 
-    XSelectInput(display_, root_, SubstructureNotifyMask | SubstructureRedirectMask);
+    // Resolve border colors to pixels. With the XCB backend the replies arrive with the sync.
+    const XBackend::ColorCookie active_color = backend_.RequestNamedColor(BORDER_COLOR_ACTIVE);
+    const XBackend::ColorCookie inactive_color = backend_.RequestNamedColor(BORDER_COLOR_INACTIVE);
+
+    // Show mouse cursor. The root window keeps the cursor, so neither it nor its font stay
+    // allocated, which XCreateFontCursor would do for the font.
+    const Font cursor_font = XLoadFont(display_, "cursor");
+    XColor black = {0, 0, 0, 0};
+    XColor white = {0, 0xffff, 0xffff, 0xffff};
+    const Cursor cursor = XCreateGlyphCursor(display_, cursor_font, cursor_font, XC_top_left_arrow,
+                                             XC_top_left_arrow + 1, &black, &white);
+    XDefineCursor(display_, root_, cursor);
+    XFreeCursor(display_, cursor);
+    XUnloadFont(display_, cursor_font);
+
+    CreateOutlineGC();
+
+    // Create status bar
+    status_bar_.reset(new StatusBar(display_, root_, kNumStatusBarSegments, kCpuSegment));
 
-    XSync(display_, false);
     if (wm_detected_) {
         LOG(ERROR) << "Detected another window manager on display " << XDisplayString(display_);
         return;
     }
 
     XSetErrorHandler(&WindowManager::OnXError);
+    TraceInit(TracePath(XDisplayString(display_)));
+
+    CHECK(backend_.AwaitNamedColor(active_color, &border_pixel_active_));
+    CHECK(backend_.AwaitNamedColor(inactive_color, &border_pixel_inactive_));
+
+    // Don't leak the X connection into spawned programs
+    fcntl(ConnectionNumber(display_), F_SETFD, FD_CLOEXEC);
+
+    // Resize throttling uses XSync counters when available
+    int sync_error_base, sync_major, sync_minor;
+    if (!XSyncQueryExtension(display_, &sync_event_base_, &sync_error_base) ||
+        !XSyncInitialize(display_, &sync_major, &sync_minor)) {
+        LOG(WARNING) << "XSync extension is not available, resizes are only rate limited";
+        sync_event_base_ = -1;
+    }
 
-    // Show mouse cursor
-    XDefineCursor(display_, root_, XCreateFontCursor(display_, XC_top_left_arrow));
+    AnnounceEwmh();
 
-    // Create status bar window
-    status_bar_window_ = XCreateSimpleWindow(
-        display_,
-        root_,
-        0, 0,
-        DisplayWidth(display_, DefaultScreen(display_)), STATUS_BAR_HEIGHT,
-        STATUS_BAR_BORDER_WIDTH,
-        STATUS_BAR_BORDER_COLOR,
-        STATUS_BAR_BG_COLOR);
-    XMapWindow(display_, status_bar_window_);
+    // Continue where the process we were restarted from left off, or create the first workspace
+    if (!RestoreState()) {
+        workspace_windows_.push_back(CreateWorkspaceWindow());
+        XMapWindow(display_, workspace_windows_[0]);
+    }
 
-    // Create first workspace
-    workspaces_.push_back(vector<Window>());
+    AdoptExistingWindows();
+
+#ifdef MSWM_COMPOSITOR
+    compositor_ = Compositor::Create(display_, &backend_, workspace_windows_);
+#endif
+
+    // Accept commands on the control socket
+    control_server_.reset(new ControlServer(
+        ControlSocketPath(XDisplayString(display_)),
+        [this](const ControlCommand* commands, size_t num_commands, ControlReplyHeader* header, string* records) {
+            ExecuteControlBatch(commands, num_commands, header, records);
+        }));
+
+    // Signals are received through a signalfd, so they are handled in the event loop
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGUSR2);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+#ifdef MSWM_STATS
+    sigaddset(&signals, SIGUSR1);
+#endif
+    PCHECK(sigprocmask(SIG_BLOCK, &signals, nullptr) == 0);
+    signal_fd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    PCHECK(signal_fd_ >= 0) << "Failed to create signalfd";
+
+    // The system state segments are refreshed on worker threads, which inherit the blocked signals
+    status_providers_.reset(new StatusProviders([this](int segment, const string& text) {
+        status_bar_->SetSegment(segment, text);
+    }));
+    status_providers_->Add(kCpuSegment, milliseconds(2000), CpuProvider());
+    status_providers_->Add(kMemorySegment, milliseconds(5000), MemoryProvider());
+    status_providers_->Add(kLoadSegment, milliseconds(5000), LoadProvider());
+    status_providers_->Add(kBatterySegment, milliseconds(30000), BatteryProvider(STATUS_BATTERY));
+    status_providers_->Add(kClockSegment, milliseconds(1000), ClockProvider(STATUS_CLOCK_FORMAT));
+
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    PCHECK(timer_fd_ >= 0) << "Failed to create timerfd";
+
+    // Wait for the X connection, the drag frame timer, signals, the control socket and the status
+    // providers together
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    PCHECK(epoll_fd_ >= 0) << "Failed to create epoll instance";
+    // Status segments show the live system, which would make replays paced by clock_ differ
+    const int status_fd = clock_ ? -1 : status_providers_->fd();
+    for (int fd : {ConnectionNumber(display_), timer_fd_, signal_fd_, control_server_->fd(), status_fd}) {
+        // The control server has no fd if its socket could not be created
+        if (fd < 0)
+            continue;
+        epoll_event event = {0};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        CHECK_EQ(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event), 0);
+    }
+
+    // Record the session for mswm_replay. A restart ends the recording, as the next process would
+    // overwrite it.
+    const char* record_path = getenv("MSWM_RECORD");
+    if (record_path != nullptr) {
+        vector<Window> windows = {status_bar_->window()};
+        windows.insert(windows.end(), workspace_windows_.begin(), workspace_windows_.end());
+        vector<pair<const char*, Atom>> atoms;
+        for (const auto& atom : kAtoms) {
+            atoms.emplace_back(atom.second, this->*atom.first);
+        }
+        EventLogHeader header;
+        FillEventLogHeader(display_, windows, atoms, &header);
+        recorder_ = EventRecorder::Open(record_path, header);
+        if (!recorder_)
+            PLOG(ERROR) << "Failed to create event log " << record_path;
+        unsetenv("MSWM_RECORD");
+    }
 
     // Main event loop
-    XEvent e;
-    while (true) {
-        XNextEvent(display_, &e);
-        // LOG(INFO) << "Received event: " << XEventCodeToString(e.type);
-
-        switch (e.type) {
-            case CreateNotify:
-                OnCreateNotify(e.xcreatewindow);
-                break;
-            case DestroyNotify:
-                OnDestroyNotify(e.xdestroywindow);
-                break;
-            case ReparentNotify:
-                OnReparentNotify(e.xreparent);
-                break;
-            case ConfigureRequest:
-                OnConfigureRequest(e.xconfigurerequest);
-                break;
-            case ConfigureNotify:
-                OnConfigureNotify(e.xconfigure);
-                break;
-            case MapRequest:
-                OnMapRequest(e.xmaprequest);
-                break;
-            case MapNotify:
-                OnMapNotify(e.xmap);
-                break;
-            case UnmapNotify:
-                OnUnmapNotify(e.xunmap);
-                break;
-            case ButtonPress:
-                OnButtonPress(e.xbutton);
-                break;
-            case ButtonRelease:
-                OnButtonRelease(e.xbutton);
-                break;
-            case MotionNotify:
-                // Skip any pending motion events
-                while (XCheckTypedWindowEvent(display_, e.xmotion.subwindow, MotionNotify, &e)) {
-                }
-                OnMotionNotify(e.xmotion);
-                break;
-            case KeyPress:
-                OnKeyPress(e.xkey);
-                break;
-            case KeyRelease:
-                OnKeyRelease(e.xkey);
-                break;
-            default:
-                LOG(WARNING) << "Ignored event: " << XEventCodeToString(e.type);
+    bool first_event = true;
+    while (running_) {
+        // Handle every event that has arrived, then send the resulting requests in one flush.
+        // Unlike XPending, QueuedAfterReading does not flush.
+        XEvent e;
+        while (XEventsQueued(display_, QueuedAfterReading) > 0) {
+            NextEvent(&e);
+            // Without the drag timer, apply the frame it would have applied before this event
+            if (clock_ && drag_.pending && Now() >= NextDragFrame())
+                ApplyDrag();
+            HandleEvent(e);
+
+            // Startup time, which is dominated by round trips on slow links
+            if (first_event) {
+                first_event = false;
+                LOG(INFO) << "Handled the first event "
+                          << duration_cast<microseconds>(steady_clock::now() - kExecTime).count() << " us after exec";
+            }
+        }
+        PublishEwmh();
+#ifdef MSWM_COMPOSITOR
+        if (compositor_)
+            compositor_->Paint();
+#endif
+        XFlush(display_);
+
+        // Don't block if flushing had to read more events
+        epoll_event events[4];
+        const int num_events = epoll_wait(epoll_fd_, events, 4, QLength(display_) > 0 ? 0 : -1);
+        for (int i = 0; i < num_events; i++) {
+            const int fd = events[i].data.fd;
+            if (fd == timer_fd_)
+                OnDragTimer();
+            else if (fd == signal_fd_)
+                OnSignal();
+            else if (fd == control_server_->fd())
+                control_server_->Dispatch();
+            else if (fd == status_providers_->fd())
+                OnStatusProviders();
+        }
+    }
+}
+
+void WindowManager::NextEvent(XEvent* e) {
+    XNextEvent(display_, e);
+    if (recorder_)
+        recorder_->Record(*e, QLength(display_));
+}
+
+void WindowManager::HandleEvent(XEvent& e) {
+#ifdef MSWM_STATS
+    EventStats::Scope stats_scope(&stats_, display_, e.type);
+#endif
+    Trace(kTraceEvent, e.type, e.xany.window);
+
+#ifdef MSWM_COMPOSITOR
+    if (compositor_ && compositor_->HandleEvent(e))
+        return;
+#endif
+
+    if (sync_event_base_ >= 0 && e.type == sync_event_base_ + XSyncAlarmNotify) {
+        OnSyncAlarm(reinterpret_cast<const XSyncAlarmNotifyEvent&>(e));
+        return;
+    }
+
+    switch (e.type) {
+        case CreateNotify:
+            OnCreateNotify(e.xcreatewindow);
+            break;
+        case DestroyNotify:
+            OnDestroyNotify(e.xdestroywindow);
+            break;
+        case ReparentNotify:
+            OnReparentNotify(e.xreparent);
+            break;
+        case ConfigureRequest:
+            OnConfigureRequest(e.xconfigurerequest);
+            break;
+        case ConfigureNotify:
+            OnConfigureNotify(e.xconfigure);
+            break;
+        case MapRequest:
+            OnMapRequest(e.xmaprequest);
+            break;
+        case MapNotify:
+            OnMapNotify(e.xmap);
+            break;
+        case UnmapNotify:
+            OnUnmapNotify(e.xunmap);
+            break;
+        case ButtonPress:
+            OnButtonPress(e.xbutton);
+            break;
+        case ButtonRelease:
+            OnButtonRelease(e.xbutton);
+            break;
+        case MotionNotify:
+            // Skip to the latest of the queued motion events. XCheckTypedEvent would flush.
+            while (XEventsQueued(display_, QueuedAfterReading) > 0) {
+                XEvent next;
+                XPeekEvent(display_, &next);
+                if (next.type != MotionNotify)
+                    break;
+                NextEvent(&e);
+            }
+            OnMotionNotify(e.xmotion);
+            break;
+        case KeyPress:
+            OnKeyPress(e.xkey);
+            break;
+        case KeyRelease:
+            OnKeyRelease(e.xkey);
+            break;
+        case MappingNotify:
+            OnMappingNotify(e.xmapping);
+            break;
+        case Expose:
+            OnExpose(e.xexpose);
+            break;
+        case PropertyNotify:
+            OnPropertyNotify(e.xproperty);
+            break;
+        default:
+            Trace(kTraceIgnoredEvent, e.type, e.xany.window);
+    }
+}
+
+void WindowManager::PublishEwmh() {
+    if (ewmh_dirty_ & kEwmhClientList) {
+        vector<unsigned long> windows;
+        windows.reserve(clients_.NumClients());
+        for (int workspace = 0; workspace < clients_.NumWorkspaces(); workspace++) {
+            clients_.ForEachClient(workspace, [&windows](Client* c) { windows.push_back(c->window); });
         }
+        XChangeProperty(display_, root_, NET_CLIENT_LIST, XA_WINDOW, 32, PropModeReplace,
+                        reinterpret_cast<const unsigned char*>(windows.data()), windows.size());
+    }
+    if (ewmh_dirty_ & kEwmhActiveWindow) {
+        const unsigned long window = active_client_ ? active_client_->window : None;
+        XChangeProperty(display_, root_, NET_ACTIVE_WINDOW, XA_WINDOW, 32, PropModeReplace,
+                        reinterpret_cast<const unsigned char*>(&window), 1);
+    }
+    if (ewmh_dirty_ & kEwmhCurrentDesktop) {
+        const unsigned long desktop = active_workspace_;
+        XChangeProperty(display_, root_, NET_CURRENT_DESKTOP, XA_CARDINAL, 32, PropModeReplace,
+                        reinterpret_cast<const unsigned char*>(&desktop), 1);
     }
+    if (ewmh_dirty_ & kEwmhNumberOfDesktops) {
+        const unsigned long desktops = clients_.NumWorkspaces();
+        XChangeProperty(display_, root_, NET_NUMBER_OF_DESKTOPS, XA_CARDINAL, 32, PropModeReplace,
+                        reinterpret_cast<const unsigned char*>(&desktops), 1);
+    }
+    ewmh_dirty_ = 0;
 }
 
 int WindowManager::OnWMDetected(Display* display, XErrorEvent* e) {
@@ -197,104 +432,618 @@ int WindowManager::OnWMDetected(Display* display, XErrorEvent* e) {
 }
 
 int WindowManager::OnXError(Display* display, XErrorEvent* e) {
+    Trace(kTraceXError, e->request_code, e->resourceid, e->error_code);
+
     char error_text[1024] = {0};
     XGetErrorText(display, e->error_code, error_text, sizeof(error_text));
     LOG(ERROR) << "Received X Error:"
                << "\n    " << error_text << " (" << int(e->error_code) << ")"
-               << "\n    Request: " << XRequestCodeToString(e->request_code) << " (" << int(e->request_code) << ")"
+               << "\n    Request: " << XRequestCodeToString(e->request_code) << " (" << int(e->request_code) << "."
+               << int(e->minor_code) << ")"
                << "\n    Resource ID: " << e->resourceid;
     return 0;
 }
 
-void WindowManager::SetWindowBorder(const Window& w, unsigned int width, const char* color_str) {
-    XSetWindowBorderWidth(display_, w, width);
-
-    Colormap colormap = DefaultColormap(display_, DefaultScreen(display_));
-    XColor color;
-    CHECK(XAllocNamedColor(display_, colormap, color_str, &color, &color));
-    XSetWindowBorder(display_, w, color.pixel);
+void WindowManager::SetBorderState(Client* c, BorderState state) {
+    if (c->border == state)
+        return;
+    c->border = state;
+
+    if (state == BorderState::kActive) {
+        XSetWindowBorderWidth(display_, c->window, BORDER_WIDTH_ACTIVE);
+        XSetWindowBorder(display_, c->window, border_pixel_active_);
+    } else {
+        XSetWindowBorderWidth(display_, c->window, BORDER_WIDTH_INACTIVE);
+        XSetWindowBorder(display_, c->window, border_pixel_inactive_);
+    }
 }
 
-void WindowManager::FocusWindow(const Window& w) {
+void WindowManager::FocusWindow(Client* c) {
+    // Only the previously active client and the new one change border state
+    if (active_client_ != nullptr && active_client_ != c)
+        SetBorderState(active_client_, BorderState::kInactive);
+
     // Raise and change border on current window
-    SetWindowBorder(w, BORDER_WIDTH_ACTIVE, BORDER_COLOR_ACTIVE);
-    XRaiseWindow(display_, w);
+    SetBorderState(c, BorderState::kActive);
+    XRaiseWindow(display_, c->window);
 
-    active_window_ = w;
+    active_client_ = c;
+    ewmh_dirty_ |= kEwmhActiveWindow;
 
-    // Change border of all other windows to inactive
-    for (auto& workspace : workspaces_) {
-        for (auto& window : workspace) {
-            if (window == w)
-                continue;
+    // Write window title to status bar
+    WriteToStatusBar(c->title);
+}
 
-            SetWindowBorder(window, BORDER_WIDTH_INACTIVE, BORDER_COLOR_INACTIVE);
-        }
+void WindowManager::RequestProperties(Window w, XBackend::PropertyCookie* cookies) {
+    // Subscribe before fetching so no change is missed in between
+    XSelectInput(display_, w, PropertyChangeMask);
+
+    const Atom properties[kNumClientProperties] = {
+        XA_WM_NAME, NET_WM_NAME, WM_PROTOCOLS, XA_WM_CLASS, XA_WM_NORMAL_HINTS, NET_WM_SYNC_REQUEST_COUNTER};
+    for (int i = 0; i < kNumClientProperties; i++) {
+        cookies[i] = backend_.RequestProperty(w, properties[i]);
     }
+}
 
-    // Write window title to status bar
-    XTextProperty xtext;
-    XGetWMName(display_, w, &xtext);
-    WriteToStatusBar(string(reinterpret_cast<char*>(xtext.value)));
+void WindowManager::AwaitProperties(Client* c, const XBackend::PropertyCookie* cookies) {
+    XBackend::Property value;
+    for (int i = 0; i < kNumClientProperties; i++) {
+        const bool exists = backend_.AwaitProperty(cookies[i], &value);
+        UpdateProperty(c, cookies[i].property, exists ? &value : nullptr);
+    }
+}
+
+void WindowManager::UpdateProperty(Client* c, Atom property, const XBackend::Property* value) {
+    if (property == XA_WM_NAME) {
+        // _NET_WM_NAME takes precedence
+        if (!(c->flags & kClientNetWMName))
+            c->title = value ? value->bytes : "";
+    } else if (property == NET_WM_NAME) {
+        if (value) {
+            c->flags |= kClientNetWMName;
+            c->title = value->bytes;
+        } else if (c->flags & kClientNetWMName) {
+            // Fall back to WM_NAME
+            c->flags &= ~kClientNetWMName;
+            XBackend::Property name;
+            const bool exists = backend_.AwaitProperty(backend_.RequestProperty(c->window, XA_WM_NAME), &name);
+            UpdateProperty(c, XA_WM_NAME, exists ? &name : nullptr);
+        }
+    } else if (property == WM_PROTOCOLS) {
+        c->flags &= ~(kClientDeleteWindow | kClientSyncRequest);
+        if (value && find(value->values.begin(), value->values.end(), WM_DELETE_WINDOW) != value->values.end())
+            c->flags |= kClientDeleteWindow;
+        if (value && find(value->values.begin(), value->values.end(), NET_WM_SYNC_REQUEST) != value->values.end())
+            c->flags |= kClientSyncRequest;
+    } else if (property == NET_WM_SYNC_REQUEST_COUNTER) {
+        c->sync_counter = value && !value->values.empty() ? value->values[0] : None;
+    } else if (property == XA_WM_CLASS) {
+        // Instance and class names, each null-terminated
+        c->wm_class.clear();
+        if (value) {
+            const size_t separator = value->bytes.find('\0');
+            if (separator != string::npos)
+                c->wm_class = value->bytes.substr(separator + 1, value->bytes.find('\0', separator + 1) - separator - 1);
+        }
+    } else if (property == XA_WM_NORMAL_HINTS) {
+        // Layout of XSizeHints: flags, x, y, width, height, min_width, min_height, max_width, max_height, ...
+        c->min_width = c->min_height = c->max_width = c->max_height = 0;
+        if (value && value->values.size() >= 9) {
+            const unsigned long flags = value->values[0];
+            if (flags & PMinSize) {
+                c->min_width = value->values[5];
+                c->min_height = value->values[6];
+            }
+            if (flags & PMaxSize) {
+                c->max_width = value->values[7];
+                c->max_height = value->values[8];
+            }
+        }
+    }
 }
 
 void WindowManager::WriteToStatusBar(const string message) {
-    // Write active workspace number and message
-    std::stringstream fmt;
-    fmt << "[" << active_workspace_ << "] " << message;
+    // Write active workspace number and message. Only changed segments are redrawn.
+    status_bar_->SetSegment(kWorkspaceSegment, "[" + std::to_string(active_workspace_) + "] " +
+                                                   LayoutSymbol(clients_.layout(active_workspace_)));
+    status_bar_->SetSegment(kTitleSegment, message);
+    status_bar_->Draw();
+}
 
-    XClearWindow(display_, status_bar_window_);
-    XDrawString(display_,
-                status_bar_window_,
-                DefaultGC(display_, DefaultScreen(display_)),
-                16, 16,
-                fmt.str().c_str(),
-                fmt.str().length());
+void WindowManager::CreateOutlineGC() {
+    // XOR pen for wireframe drags, drawn over all windows
+    XGCValues outline_values;
+    outline_values.function = GXxor;
+    outline_values.foreground = WhitePixel(display_, DefaultScreen(display_)) ^ BlackPixel(display_, DefaultScreen(display_));
+    outline_values.line_width = BORDER_WIDTH_ACTIVE;
+    outline_values.subwindow_mode = IncludeInferiors;
+    outline_gc_ = XCreateGC(display_, root_, GCFunction | GCForeground | GCLineWidth | GCSubwindowMode, &outline_values);
 }
 
-void WindowManager::SwitchWorkspace(const int workspace) {
-    CHECK(workspace >= 0);
-    CHECK(workspace < num_workspaces_);
+void WindowManager::AnnounceEwmh() {
+    // The status bar doubles as the supporting WM check window
+    const Window check_window = status_bar_->window();
+    const Atom supported[] = {NET_SUPPORTED, NET_SUPPORTING_WM_CHECK, NET_WM_NAME, NET_CLIENT_LIST,
+                              NET_ACTIVE_WINDOW, NET_CURRENT_DESKTOP, NET_NUMBER_OF_DESKTOPS};
+    XChangeProperty(display_, root_, NET_SUPPORTED, XA_ATOM, 32, PropModeReplace,
+                    reinterpret_cast<const unsigned char*>(supported), sizeof(supported) / sizeof(supported[0]));
+    for (Window w : {root_, check_window}) {
+        XChangeProperty(display_, w, NET_SUPPORTING_WM_CHECK, XA_WINDOW, 32, PropModeReplace,
+                        reinterpret_cast<const unsigned char*>(&check_window), 1);
+    }
+    XChangeProperty(display_, check_window, NET_WM_NAME, UTF8_STRING, 8, PropModeReplace,
+                    reinterpret_cast<const unsigned char*>("mswm"), 4);
+}
 
-    // Create new workspace if needed
-    if (workspace == workspaces_.size()) {
-        workspaces_.push_back(vector<Window>());
+unsigned int WindowManager::LockModifierVariant(int i) const {
+    // The four combinations of CapsLock and NumLock
+    return (i & 1 ? LockMask : 0) | (i & 2 ? numlock_mask_ : 0);
+}
+
+void WindowManager::GrabButtons(Window w) {
+    // Alt + Mouse buttons. Grabbed on the workspace windows so that the event's subwindow is the
+    // client under the pointer.
+    XUngrabButton(display_, AnyButton, AnyModifier, w);
+    for (int i = 0; i < 4; i++) {
+        XGrabButton(display_,
+                    AnyButton,
+                    Mod1Mask | LockModifierVariant(i),
+                    w,
+                    True,
+                    ButtonPressMask | ButtonReleaseMask | PointerMotionMask | OwnerGrabButtonMask,
+                    GrabModeAsync,
+                    GrabModeAsync,
+                    None,
+                    None);
+    }
+}
+
+void WindowManager::GrabKeys() {
+    // Find the modifier NumLock is mapped to
+    numlock_mask_ = 0;
+    XModifierKeymap* modmap = XGetModifierMapping(display_);
+    const KeyCode numlock = XKeysymToKeycode(display_, XK_Num_Lock);
+    for (int i = 0; i < 8 * modmap->max_keypermod; i++) {
+        if (numlock != 0 && modmap->modifiermap[i] == numlock)
+            numlock_mask_ = 1 << (i / modmap->max_keypermod);
     }
+    XFreeModifiermap(modmap);
+
+    // Resolve bindings to keycodes and grab them with every lock modifier variant
+    key_map_.clear();
+    XUngrabKey(display_, AnyKey, AnyModifier, root_);
+    for (const KeyBinding& binding : kKeyBindings) {
+        const KeyCode keycode = XKeysymToKeycode(display_, binding.keysym);
+        if (keycode == 0)
+            continue;
+
+        key_map_[KeyMapIndex(keycode, binding.modifiers)] = &binding;
+        for (int i = 0; i < 4; i++) {
+            XGrabKey(display_, keycode, binding.modifiers | LockModifierVariant(i), root_, False, GrabModeAsync, GrabModeAsync);
+        }
+    }
+}
+
+void WindowManager::OnDragTimer() {
+    uint64_t expirations;
+    if (read(timer_fd_, &expirations, sizeof(expirations)) < 0)
+        return;
+
+    // The drag may have ended or been applied since the timer was armed
+    if (!drag_.pending)
+        return;
+    if (Now() >= NextDragFrame())
+        ApplyDrag();
+    else
+        ArmDragTimer();
+}
+
+void WindowManager::ArmDragTimer() {
+    // The event loop applies due frames itself
+    if (clock_)
+        return;
+
+    const long delay_ns = max<long>(duration_cast<nanoseconds>(NextDragFrame() - steady_clock::now()).count(), 1);
+    const itimerspec spec = {{0, 0}, {delay_ns / 1000000000, delay_ns % 1000000000}};
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
+}
+
+void WindowManager::OnStatusProviders() {
+    // Only the segments whose text changed are redrawn
+    status_providers_->Dispatch();
+    status_bar_->Draw();
+}
 
-    // Hide windows of current workspace
-    for (auto& window : workspaces_[active_workspace_]) {
-        XWithdrawWindow(display_, window, DefaultScreen(display_));
+void WindowManager::OnSignal() {
+    signalfd_siginfo info;
+    while (read(signal_fd_, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+            case SIGUSR2:
+                if (!TraceDump())
+                    PLOG(ERROR) << "Failed to write trace file";
+                break;
+            case SIGHUP:
+                Restart(0);
+                break;
+            case SIGINT:
+            case SIGTERM:
+                running_ = false;
+                break;
+            case SIGCHLD:
+                // Several exits may be merged into one signal
+                while (waitpid(-1, nullptr, WNOHANG) > 0) {
+                }
+                break;
+#ifdef MSWM_STATS
+            case SIGUSR1:
+                stats_.Dump();
+                break;
+#endif
+        }
     }
+}
 
-    // Show windows of new workspace
-    for (auto& window : workspaces_[workspace]) {
-        XMapWindow(display_, window);
+void WindowManager::GrabServer() {
+    if (server_grabs_++ == 0)
+        XGrabServer(display_);
+}
+
+void WindowManager::UngrabServer() {
+    if (--server_grabs_ == 0)
+        XUngrabServer(display_);
+}
+
+void WindowManager::ExecuteControlBatch(const ControlCommand* commands,
+                                        size_t num_commands,
+                                        ControlReplyHeader* header,
+                                        string* records) {
+    auto append_record = [records](const Client* c) {
+        const ControlClientRecord record = {
+            static_cast<uint32_t>(c->window), c->workspace, c->x, c->y, c->width, c->height};
+        records->append(reinterpret_cast<const char*>(&record), sizeof(record));
+        return true;
+    };
+
+    // Apply the whole batch under one server grab; the event loop flushes it
+    GrabServer();
+    for (size_t i = 0; i < num_commands; i++) {
+        const ControlCommand& command = commands[i];
+        Client* c = clients_.Find(command.window);
+        bool ok = c != nullptr;
+
+        switch (command.opcode) {
+            case kControlFocus:
+                if (ok) {
+                    if (c->workspace != active_workspace_)
+                        SwitchWorkspace(c->workspace);
+                    FocusWindow(c);
+                }
+                break;
+            case kControlMove:
+                // The layout of a tiled workspace decides where its clients go
+                ok = ok && clients_.layout(c->workspace) == Layout::kFloating;
+                if (ok) {
+                    c->x = command.args[0];
+                    c->y = max(command.args[1], STATUS_BAR_HEIGHT);
+                    XMoveWindow(display_, c->window, c->x, c->y);
+                }
+                break;
+            case kControlResize:
+                ok = ok && clients_.layout(c->workspace) == Layout::kFloating;
+                if (ok) {
+                    c->width = max(command.args[0], MIN_WINDOW_WIDTH);
+                    c->height = max(command.args[1], MIN_WINDOW_HEIGHT);
+                    XResizeWindow(display_, c->window, c->width, c->height);
+                }
+                break;
+            case kControlSendToWorkspace:
+                // Sending to the workspace past the last one creates it
+                ok = ok && command.args[0] >= 0 && command.args[0] <= clients_.NumWorkspaces();
+                if (ok) {
+                    if (command.args[0] == clients_.NumWorkspaces()) {
+                        clients_.AddWorkspace();
+                        workspace_windows_.push_back(CreateWorkspaceWindow());
+                        ewmh_dirty_ |= kEwmhNumberOfDesktops;
+                    }
+                    MoveClientToWorkspace(c, command.args[0]);
+                }
+                break;
+            case kControlQueryClients:
+                ok = true;
+                for (int workspace = 0; workspace < clients_.NumWorkspaces(); workspace++) {
+                    clients_.ForEachClient(workspace, [&](Client* client) {
+                        append_record(client);
+                        header->num_records++;
+                    });
+                }
+                break;
+            case kControlQueryGeometry:
+                if (ok) {
+                    append_record(c);
+                    header->num_records++;
+                }
+                break;
+            default:
+                ok = false;
+        }
+
+        if (!ok)
+            header->num_failed++;
+    }
+    UngrabServer();
+}
+
+steady_clock::time_point WindowManager::Now() const {
+    return clock_ ? clock_() : steady_clock::now();
+}
+
+steady_clock::time_point WindowManager::NextDragFrame() const {
+    const steady_clock::time_point frame = drag_.last_apply_time + microseconds(1000000 / DRAG_FRAME_RATE);
+    // Until the client has painted the last size, or gives up on it
+    if (drag_.awaiting_sync)
+        return max(frame, drag_.last_apply_time + milliseconds(SYNC_REQUEST_TIMEOUT_MS));
+    return frame;
+}
+
+void WindowManager::ApplyDrag() {
+    drag_.pending = false;
+    drag_.last_apply_time = Now();
+
+    Client* c = drag_.client;
+    const pair<int, int> delta = {drag_.pos.first - drag_.start_pos.first,
+                                  drag_.pos.second - drag_.start_pos.second};
+
+    // What is on screen: the outline in wireframe mode, the window otherwise
+    const Rect current = drag_.wireframe ? drag_.outline : Rect{c->x, c->y, c->width, c->height};
+    Rect target = current;
+
+    if (drag_.mode == DragMode::kMove) {
+        const pair<int, int> dest_frame_pos = {drag_.start_frame_pos.first + delta.first,
+                                               drag_.start_frame_pos.second + delta.second};
+
+        // Don't move window above status bar, but keep following the pointer horizontally
+        target.x = dest_frame_pos.first;
+        target.y = max(dest_frame_pos.second, STATUS_BAR_HEIGHT);
+
+        // Snap to nearby window and screen edges
+        const int outer_width = target.width + 2 * BORDER_WIDTH_ACTIVE;
+        const int outer_height = target.height + 2 * BORDER_WIDTH_ACTIVE;
+        target.x += SnapOffset(EdgeIndex::kVertical, target.x, target.x + outer_width, target.y, target.y + outer_height);
+        target.y += SnapOffset(EdgeIndex::kHorizontal, target.y, target.y + outer_height, target.x, target.x + outer_width);
+        target.y = max(target.y, STATUS_BAR_HEIGHT);
+    }
+
+    if (drag_.mode == DragMode::kResize) {
+        const pair<int, int> size_delta = {max(delta.first, -drag_.start_frame_size.first),
+                                           max(delta.second, -drag_.start_frame_size.second)};
+        pair<int, int> dest_frame_size = {drag_.start_frame_size.first + size_delta.first,
+                                          drag_.start_frame_size.second + size_delta.second};
+
+        // Snap the right and bottom sides to nearby window and screen edges
+        const int right = target.x + dest_frame_size.first + 2 * BORDER_WIDTH_ACTIVE;
+        const int bottom = target.y + dest_frame_size.second + 2 * BORDER_WIDTH_ACTIVE;
+        dest_frame_size.first += SnapOffset(EdgeIndex::kVertical, target.x, right, target.y, bottom);
+        dest_frame_size.second += SnapOffset(EdgeIndex::kHorizontal, target.y, bottom, target.x, right);
+
+        // Restrict minimum window size, and respect the client's size hints
+        dest_frame_size.first = max(dest_frame_size.first, max(MIN_WINDOW_WIDTH, c->min_width));
+        dest_frame_size.second = max(dest_frame_size.second, max(MIN_WINDOW_HEIGHT, c->min_height));
+        if (c->max_width > 0)
+            dest_frame_size.first = min(dest_frame_size.first, c->max_width);
+        if (c->max_height > 0)
+            dest_frame_size.second = min(dest_frame_size.second, c->max_height);
+
+        target.width = dest_frame_size.first;
+        target.height = dest_frame_size.second;
+    }
+
+    if (target == current)
+        return;
+
+    if (drag_.wireframe) {
+        // Erase the old outline and draw the new one
+        DrawOutline(drag_.outline);
+        drag_.outline = target;
+        DrawOutline(drag_.outline);
+        return;
     }
 
+    if (drag_.mode == DragMode::kMove) {
+        c->x = target.x;
+        c->y = target.y;
+        XMoveWindow(display_, c->window, c->x, c->y);
+        drag_.configures++;
+    }
+
+    if (drag_.mode == DragMode::kResize) {
+        // Ask the client to update its sync counter once it has painted the new size
+        if (drag_.sync_alarm != None) {
+            drag_.sync_value++;
+            XEvent msg = {0};
+            msg.xclient.type = ClientMessage;
+            msg.xclient.message_type = WM_PROTOCOLS;
+            msg.xclient.window = c->window;
+            msg.xclient.format = 32;
+            msg.xclient.data.l[0] = NET_WM_SYNC_REQUEST;
+            msg.xclient.data.l[1] = CurrentTime;
+            msg.xclient.data.l[2] = drag_.sync_value & 0xffffffff;
+            msg.xclient.data.l[3] = drag_.sync_value >> 32;
+            XSendEvent(display_, c->window, false, NoEventMask, &msg);
+
+            XSyncAlarmAttributes attrs;
+            XSyncIntsToValue(&attrs.trigger.wait_value, drag_.sync_value & 0xffffffff, drag_.sync_value >> 32);
+            XSyncChangeAlarm(display_, drag_.sync_alarm, XSyncCAValue, &attrs);
+            drag_.awaiting_sync = true;
+        }
+
+        // Resize window
+        c->width = target.width;
+        c->height = target.height;
+        XResizeWindow(display_, c->window, c->width, c->height);
+        drag_.configures++;
+    }
+}
+
+void WindowManager::DrawOutline(const Rect& frame) {
+    // Drawing the same outline twice erases it
+    const unsigned int border = 2 * BORDER_WIDTH_ACTIVE;
+    XDrawRectangle(display_, root_, outline_gc_, frame.x, frame.y, frame.width + border - 1, frame.height + border - 1);
+}
+
+void WindowManager::IndexSnapEdges(const Client* dragged) {
+    const int width = DisplayWidth(display_, DefaultScreen(display_));
+    const int height = DisplayHeight(display_, DefaultScreen(display_));
+    snap_edges_.Reset(width, height);
+
+    // The workspace area below the status bar
+    snap_edges_.AddEdge(EdgeIndex::kVertical, 0, 0, height);
+    snap_edges_.AddEdge(EdgeIndex::kVertical, width, 0, height);
+    snap_edges_.AddEdge(EdgeIndex::kHorizontal, STATUS_BAR_HEIGHT, 0, width);
+    snap_edges_.AddEdge(EdgeIndex::kHorizontal, height, 0, width);
+
+    clients_.ForEachClient(dragged->workspace, [this, dragged](Client* c) {
+        if (c == dragged)
+            return;
+        const unsigned int border = 2 * (c->border == BorderState::kActive ? BORDER_WIDTH_ACTIVE : BORDER_WIDTH_INACTIVE);
+        snap_edges_.AddRect({c->x, c->y, c->width + border, c->height + border});
+    });
+}
+
+int WindowManager::SnapOffset(EdgeIndex::Axis axis, int begin, int end, int span_begin, int span_end) const {
+    int offset = SNAP_DISTANCE + 1;
+    int edge;
+    if (snap_edges_.Nearest(axis, end, span_begin, span_end, SNAP_DISTANCE, &edge))
+        offset = edge - end;
+    if (drag_.mode == DragMode::kMove && snap_edges_.Nearest(axis, begin, span_begin, span_end, SNAP_DISTANCE, &edge) &&
+        abs(edge - begin) < abs(offset))
+        offset = edge - begin;
+    return abs(offset) <= SNAP_DISTANCE ? offset : 0;
+}
+
+void WindowManager::EndDrag() {
+    if (drag_.sync_alarm != None)
+        XSyncDestroyAlarm(display_, drag_.sync_alarm);
+    if (drag_.wireframe) {
+        if (drag_.outline_visible)
+            DrawOutline(drag_.outline);
+        UngrabServer();
+    }
+    drag_ = Drag();
+}
+
+void WindowManager::OnSyncAlarm(const XSyncAlarmNotifyEvent& e) {
+    if (drag_.sync_alarm == None || e.alarm != drag_.sync_alarm || !drag_.awaiting_sync)
+        return;
+
+    // The client caught up with the last resize; the next one may follow at the next frame
+    if (XSyncValueLessThan(e.counter_value, e.alarm_value))
+        return;
+    drag_.awaiting_sync = false;
+    if (!drag_.pending)
+        return;
+    if (Now() >= NextDragFrame())
+        ApplyDrag();
+    else
+        ArmDragTimer();
+}
+
+Window WindowManager::CreateWorkspaceWindow() {
+    XSetWindowAttributes attrs;
+    attrs.background_pixmap = ParentRelative;
+    attrs.event_mask = SubstructureNotifyMask | SubstructureRedirectMask;
+    const Window w = XCreateWindow(display_,
+                                   root_,
+                                   0, 0,
+                                   DisplayWidth(display_, DefaultScreen(display_)),
+                                   DisplayHeight(display_, DefaultScreen(display_)),
+                                   0,
+                                   CopyFromParent,
+                                   InputOutput,
+                                   CopyFromParent,
+                                   CWBackPixmap | CWEventMask,
+                                   &attrs);
+
+    // Keep workspaces below the status bar
+    XLowerWindow(display_, w);
+    GrabButtons(w);
+#ifdef MSWM_COMPOSITOR
+    if (compositor_)
+        compositor_->AddContainer(w);
+#endif
+    return w;
+}
+
+void WindowManager::DestroyUnusedWorkspaceWindows() {
+    while (workspace_windows_.size() > static_cast<size_t>(clients_.NumWorkspaces())) {
+        XDestroyWindow(display_, workspace_windows_.back());
+        workspace_windows_.pop_back();
+    }
+}
+
+void WindowManager::SwitchWorkspace(const int workspace) {
+    CHECK(workspace >= 0);
+    CHECK(workspace < clients_.NumWorkspaces());
+
+    // Swap the workspace windows under a server grab so no intermediate frame is drawn
+    GrabServer();
+    XMapWindow(display_, workspace_windows_[workspace]);
+    XUnmapWindow(display_, workspace_windows_[active_workspace_]);
+    UngrabServer();
+
     active_workspace_ = workspace;
+
+    // Forget empty workspaces past the active one
+    clients_.TrimWorkspaces(active_workspace_);
+    ewmh_dirty_ |= kEwmhCurrentDesktop | kEwmhNumberOfDesktops;
+    DestroyUnusedWorkspaceWindows();
+
     WriteToStatusBar("");
 }
 
 void WindowManager::CreateWorkspace() {
-    num_workspaces_++;
-    SwitchWorkspace(num_workspaces_ - 1);
+    clients_.AddWorkspace();
+    workspace_windows_.push_back(CreateWorkspaceWindow());
+    SwitchWorkspace(clients_.NumWorkspaces() - 1);
 }
 
 void WindowManager::OnCreateNotify(const XCreateWindowEvent& e) {}
 
 void WindowManager::OnDestroyNotify(const XDestroyWindowEvent& e) {
-    // Remove window from windows vector and switch active window
-    for (auto& workspace : workspaces_) {
-        auto it = find(workspace.begin(), workspace.end(), e.window);
-        if (it != workspace.end()) {
-            workspace.erase(it);
-        }
+    Client* c = clients_.Find(e.window);
+    if (c == nullptr)
+        return;
+
+    if (active_client_ == c) {
+        active_client_ = nullptr;
+        ewmh_dirty_ |= kEwmhActiveWindow;
     }
+    if (drag_.client == c)
+        EndDrag();
+    const int workspace = c->workspace;
+    clients_.Remove(c);
+    ewmh_dirty_ |= kEwmhClientList;
+    ArrangeWorkspace(workspace);
 }
 
 void WindowManager::OnReparentNotify(const XReparentEvent& e) {}
 
 void WindowManager::OnConfigureRequest(const XConfigureRequestEvent& e) {
+    // Tiled clients keep their cell and are told their current geometry instead
+    Client* c = clients_.Find(e.window);
+    if (c != nullptr && clients_.layout(c->workspace) != Layout::kFloating) {
+        XEvent notify = {0};
+        notify.xconfigure.type = ConfigureNotify;
+        notify.xconfigure.event = c->window;
+        notify.xconfigure.window = c->window;
+        notify.xconfigure.x = c->x;
+        notify.xconfigure.y = c->y;
+        notify.xconfigure.width = c->width;
+        notify.xconfigure.height = c->height;
+        notify.xconfigure.border_width = c->border == BorderState::kActive ? BORDER_WIDTH_ACTIVE : BORDER_WIDTH_INACTIVE;
+        XSendEvent(display_, c->window, false, StructureNotifyMask, &notify);
+        return;
+    }
+
     XWindowChanges wc;
     wc.x = e.x;
     wc.y = e.y;
@@ -306,17 +1055,257 @@ void WindowManager::OnConfigureRequest(const XConfigureRequestEvent& e) {
     XConfigureWindow(display_, e.window, e.value_mask, &wc);
 }
 
-void WindowManager::OnConfigureNotify(const XConfigureEvent& e) {}
+void WindowManager::OnConfigureNotify(const XConfigureEvent& e) {
+    // Keep the cached geometry current, including configures the clients made themselves. During a
+    // drag the cache is ahead of the server, so notifies for the dragged window would be stale.
+    Client* c = clients_.Find(e.window);
+    if (c == nullptr || e.send_event || c == drag_.client)
+        return;
+
+    c->x = e.x;
+    c->y = e.y;
+    c->width = e.width;
+    c->height = e.height;
+}
+
+void WindowManager::AdoptExistingWindows() {
+    const steady_clock::time_point start_time = steady_clock::now();
+    GrabServer();
+
+    vector<Window> windows;
+    CHECK(backend_.AwaitTree(backend_.RequestTree(root_), &windows));
+
+    // Each step requests everything for all windows before awaiting the first reply, so with the
+    // XCB backend a step is one round trip however many windows there are
+    vector<XBackend::AttributesCookie> attributes_cookies;
+    vector<XBackend::GeometryCookie> geometry_cookies;
+    for (Window w : windows) {
+        attributes_cookies.push_back(backend_.RequestAttributes(w));
+        geometry_cookies.push_back(backend_.RequestGeometry(w));
+    }
+
+    // Adopt mapped top-level windows that aren't ours
+    vector<Client*> adopted;
+    for (size_t i = 0; i < windows.size(); i++) {
+        XBackend::Attributes attributes;
+        XBackend::Geometry geometry;
+        const bool exists = backend_.AwaitAttributes(attributes_cookies[i], &attributes);
+        if (!backend_.AwaitGeometry(geometry_cookies[i], &geometry) || !exists)
+            continue;
+        if (attributes.override_redirect || attributes.map_state != IsViewable ||
+            windows[i] == status_bar_->window() ||
+            find(workspace_windows_.begin(), workspace_windows_.end(), windows[i]) != workspace_windows_.end())
+            continue;
+
+        Client* c = clients_.Add(windows[i], active_workspace_);
+        c->x = geometry.x;
+        c->y = max(geometry.y, STATUS_BAR_HEIGHT);
+        c->width = geometry.width;
+        c->height = geometry.height;
+        adopted.push_back(c);
+    }
+
+    vector<XBackend::PropertyCookie> property_cookies(adopted.size() * kNumClientProperties);
+    for (size_t i = 0; i < adopted.size(); i++) {
+        RequestProperties(adopted[i]->window, &property_cookies[i * kNumClientProperties]);
+    }
+    for (size_t i = 0; i < adopted.size(); i++) {
+        Client* c = adopted[i];
+        AwaitProperties(c, &property_cookies[i * kNumClientProperties]);
+
+        // Same as a newly mapped window, but in its current position and stacking order
+        XAddToSaveSet(display_, c->window);
+        XReparentWindow(display_, c->window, workspace_windows_[active_workspace_], c->x, c->y);
+        SetBorderState(c, BorderState::kInactive);
+        Trace(kTraceMapWindow, 0, c->window);
+    }
+
+    ArrangeWorkspace(active_workspace_);
+
+    // The top-most window gets the focus
+    if (!adopted.empty())
+        FocusWindow(adopted.back());
+
+    UngrabServer();
+    LOG(INFO) << "Adopted " << adopted.size() << " of " << windows.size() << " existing windows in "
+              << duration_cast<microseconds>(steady_clock::now() - start_time).count() << " us";
+}
+
+void WindowManager::SaveState() {
+    Snapshot snapshot;
+    snapshot.active_workspace = active_workspace_;
+    snapshot.active_window = active_client_ ? active_client_->window : None;
+    for (int workspace = 0; workspace < clients_.NumWorkspaces(); workspace++) {
+        snapshot.workspaces.push_back({workspace_windows_[workspace], clients_.layout(workspace)});
+        clients_.ForEachClient(workspace, [&snapshot](Client* c) {
+            snapshot.clients.push_back({c->window, c->workspace, c->x, c->y, c->width, c->height});
+        });
+    }
+    snapshot.time_ns = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+
+    const vector<unsigned long> values = snapshot.Encode();
+    XChangeProperty(display_, root_, MSWM_STATE, MSWM_STATE, 32, PropModeReplace,
+                    reinterpret_cast<const unsigned char*>(values.data()), values.size());
+}
+
+bool WindowManager::RestoreState() {
+    XBackend::Property value;
+    const bool exists = backend_.AwaitProperty(backend_.RequestProperty(root_, MSWM_STATE, 1 << 20), &value);
+    Snapshot snapshot;
+    if (!exists)
+        return false;
+    XDeleteProperty(display_, root_, MSWM_STATE);
+    if (value.format != 32 || !snapshot.Decode(value.values)) {
+        LOG(WARNING) << "Ignoring invalid state snapshot";
+        return false;
+    }
+
+    // Windows may have been destroyed while nobody managed them
+    vector<XBackend::AttributesCookie> workspace_cookies;
+    vector<XBackend::AttributesCookie> client_cookies;
+    for (const Snapshot::WorkspaceRecord& record : snapshot.workspaces) {
+        workspace_cookies.push_back(backend_.RequestAttributes(record.window));
+    }
+    for (const Snapshot::ClientRecord& record : snapshot.clients) {
+        client_cookies.push_back(backend_.RequestAttributes(record.window));
+    }
+    bool workspaces_exist = true;
+    for (const XBackend::AttributesCookie& cookie : workspace_cookies) {
+        XBackend::Attributes attributes;
+        workspaces_exist = backend_.AwaitAttributes(cookie, &attributes) && workspaces_exist;
+    }
+
+    // The clients stay in the workspace windows retained from the previous process, so they are
+    // neither reparented nor remapped
+    GrabServer();
+    for (size_t i = 0; i < snapshot.workspaces.size(); i++) {
+        workspace_windows_.push_back(snapshot.workspaces[i].window);
+        // The event selection of the previous process went away with its connection
+        XSelectInput(display_, workspace_windows_[i], SubstructureNotifyMask | SubstructureRedirectMask);
+        GrabButtons(workspace_windows_[i]);
+        if (static_cast<int>(i) == clients_.NumWorkspaces())
+            clients_.AddWorkspace();
+        clients_.SetLayout(i, snapshot.workspaces[i].layout);
+    }
+    active_workspace_ = snapshot.active_workspace;
+
+    vector<Client*> restored;
+    for (size_t i = 0; i < snapshot.clients.size(); i++) {
+        XBackend::Attributes attributes;
+        if (!backend_.AwaitAttributes(client_cookies[i], &attributes))
+            continue;
+
+        const Snapshot::ClientRecord& record = snapshot.clients[i];
+        Client* c = clients_.Add(record.window, record.workspace);
+        c->x = record.x;
+        c->y = record.y;
+        c->width = record.width;
+        c->height = record.height;
+        // The previous process left the border in place
+        c->border = BorderState::kInactive;
+        XAddToSaveSet(display_, c->window);
+        restored.push_back(c);
+    }
+
+    vector<XBackend::PropertyCookie> property_cookies(restored.size() * kNumClientProperties);
+    for (size_t i = 0; i < restored.size(); i++) {
+        RequestProperties(restored[i]->window, &property_cookies[i * kNumClientProperties]);
+    }
+    for (size_t i = 0; i < restored.size(); i++) {
+        AwaitProperties(restored[i], &property_cookies[i * kNumClientProperties]);
+    }
+
+    Client* active_client = clients_.Find(snapshot.active_window);
+    if (active_client != nullptr)
+        FocusWindow(active_client);
+    else
+        WriteToStatusBar("");
+
+    UngrabServer();
+
+    if (!workspaces_exist)
+        LOG(WARNING) << "Some workspace windows were destroyed during the restart";
+
+    const uint64_t now_ns = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+    LOG(INFO) << "Restored " << restored.size() << " clients on " << workspace_windows_.size()
+              << " workspaces, " << (now_ns - snapshot.time_ns) / 1000 << " us after the restart";
+    return true;
+}
+
+void WindowManager::Restart(int arg) {
+    // Only the workspace windows the clients live in may outlive the connection, which closes on
+    // exec. The next process takes them over. Everything else is freed first, since nobody could
+    // free it later.
+    SaveState();
+    if (drag_.mode != DragMode::kNone)
+        EndDrag();
+#ifdef MSWM_COMPOSITOR
+    // A retained redirection would keep the next process from compositing
+    compositor_.reset();
+#endif
+    XFreeGC(display_, outline_gc_);
+    status_bar_.reset();
+    XSetCloseDownMode(display_, RetainTemporary);
+    XSync(display_, false);
+    recorder_.reset();
+    google::FlushLogFiles(google::INFO);
+
+    // Exec the binary by name, so that an upgraded binary is picked up
+    char* argv[] = {program_invocation_name, nullptr};
+    execvp(argv[0], argv);
+
+    PLOG(ERROR) << "Failed to restart " << program_invocation_name;
+    XSetCloseDownMode(display_, DestroyAll);
+    XDeleteProperty(display_, root_, MSWM_STATE);
+
+    // Carry on with what was freed recreated. The system segments of the status bar stay empty
+    // until their text changes.
+    CreateOutlineGC();
+    status_bar_.reset(new StatusBar(display_, root_, kNumStatusBarSegments, kCpuSegment));
+    AnnounceEwmh();
+    WriteToStatusBar(active_client_ ? active_client_->title : "");
+}
 
 void WindowManager::OnMapRequest(const XMapRequestEvent& e) {
-    workspaces_[active_workspace_].push_back(e.window);
+    Client* c = clients_.Find(e.window);
+    if (c == nullptr) {
+        c = clients_.Add(e.window, active_workspace_);
+        // The size is known before anything else sees the client, such as snapping or a geometry
+        // query. The geometry is requested together with the properties.
+        const XBackend::GeometryCookie geometry_cookie = backend_.RequestGeometry(e.window);
+        XBackend::PropertyCookie property_cookies[kNumClientProperties];
+        RequestProperties(e.window, property_cookies);
+        XBackend::Geometry geometry;
+        if (backend_.AwaitGeometry(geometry_cookie, &geometry)) {
+            c->x = geometry.x;
+            c->y = max(geometry.y, STATUS_BAR_HEIGHT);
+            c->width = geometry.width;
+            c->height = geometry.height;
+        }
+        AwaitProperties(c, property_cookies);
+        ewmh_dirty_ |= kEwmhClientList;
+
+        // Make sure the client survives us exiting, since its parent is our workspace window
+        XAddToSaveSet(display_, e.window);
+    } else if (c->workspace != active_workspace_) {
+        const int workspace = c->workspace;
+        clients_.MoveToWorkspace(c, active_workspace_);
+        ArrangeWorkspace(workspace);
+    }
+    if (clients_.layout(active_workspace_) == Layout::kFloating) {
+        c->x = 0;
+        c->y = STATUS_BAR_HEIGHT;
+    } else {
+        ArrangeWorkspace(active_workspace_);
+    }
 
+    // Place the window in the active workspace
+    XReparentWindow(display_, e.window, workspace_windows_[active_workspace_], c->x, c->y);
     XMapWindow(display_, e.window);
-    XReparentWindow(display_, e.window, root_, 0, 0);
-    XMoveWindow(display_, e.window, 0, STATUS_BAR_HEIGHT);
-    FocusWindow(e.window);
+    SetBorderState(c, BorderState::kInactive);
+    FocusWindow(c);
 
-    LOG(INFO) << "Mapped window " << e.window;
+    Trace(kTraceMapWindow, 0, e.window);
 }
 
 void WindowManager::OnMapNotify(const XMapEvent& e) {}
@@ -324,44 +1313,73 @@ void WindowManager::OnMapNotify(const XMapEvent& e) {}
 void WindowManager::OnUnmapNotify(const XUnmapEvent& e) {}
 
 void WindowManager::OnButtonPress(const XButtonEvent& e) {
-    if (e.subwindow == None)
+    // Another button pressed during a drag must not start a second one over it, which would grab
+    // the server twice and leave the first outline on screen
+    if (drag_.mode != DragMode::kNone)
         return;
 
-    // Save initial cursor position
-    drag_start_pos_ = {e.x_root, e.y_root};
-
-    // Save initial window info
-    Window returned_root;
-    int x, y;
-    unsigned width, height, border_width, depth;
-    CHECK(XGetGeometry(
-        display_,
-        e.subwindow,
-        &returned_root,
-        &x,
-        &y,
-        &width,
-        &height,
-        &border_width,
-        &depth));
-
-    drag_start_frame_pos_ = {x, y};
-    drag_start_frame_size_ = {width, height};
+    Client* c = clients_.Find(e.subwindow);
+    if (c == nullptr)
+        return;
 
     // Raise window and change border to active
-    FocusWindow(e.subwindow);
+    FocusWindow(c);
 
     // Alt
     if (e.state & Mod1Mask) {
+        // Alt + Left button to move and Alt + Right button to resize
+        if ((e.button == Button1 || e.button == Button3) && clients_.layout(c->workspace) == Layout::kFloating) {
+            drag_ = Drag();
+            drag_.mode = e.button == Button1 ? DragMode::kMove : DragMode::kResize;
+            drag_.button = e.button;
+            drag_.client = c;
+            drag_.start_pos = {e.x_root, e.y_root};
+            drag_.start_frame_pos = {c->x, c->y};
+            drag_.start_frame_size = {c->width, c->height};
+            drag_.pos = drag_.start_pos;
+            drag_.start_time = Now();
+            IndexSnapEdges(c);
+
+            // Nobody else may draw while the XOR outline is on screen, or erasing it would leave
+            // traces
+            drag_.wireframe = WIREFRAME_DRAG;
+#ifdef MSWM_COMPOSITOR
+            // The outline would be drawn under the composite overlay, and moves are cheap anyway
+            drag_.wireframe = drag_.wireframe && !compositor_;
+#endif
+            if (drag_.wireframe) {
+                GrabServer();
+                drag_.outline = {c->x, c->y, c->width, c->height};
+                DrawOutline(drag_.outline);
+                drag_.outline_visible = true;
+            }
+
+            // Requested values must be above the counter's current value
+            XSyncValue counter_value;
+            if (drag_.mode == DragMode::kResize && !drag_.wireframe && sync_event_base_ >= 0 && (c->flags & kClientSyncRequest) &&
+                c->sync_counter != None && XSyncQueryCounter(display_, c->sync_counter, &counter_value)) {
+                drag_.sync_value = (static_cast<int64_t>(XSyncValueHigh32(counter_value)) << 32) | XSyncValueLow32(counter_value);
+
+                XSyncAlarmAttributes attrs;
+                attrs.trigger.counter = c->sync_counter;
+                attrs.trigger.value_type = XSyncAbsolute;
+                attrs.trigger.test_type = XSyncPositiveComparison;
+                attrs.trigger.wait_value = counter_value;
+                XSyncIntToValue(&attrs.delta, 0);
+                attrs.events = true;
+                drag_.sync_alarm = XSyncCreateAlarm(display_,
+                                                    XSyncCACounter | XSyncCAValueType | XSyncCATestType | XSyncCAValue |
+                                                        XSyncCADelta | XSyncCAEvents,
+                                                    &attrs);
+            }
+        }
+
         // Alt + Middle button to close window
         if (e.button == Button2) {
             // Try to gracefully kill client if the client supports the WM_DELETE_WINDOW behavior.
             // Otherwise, kill it.
-            Atom* supported_protocols;
-            int num_supported_protocols;
-            if (XGetWMProtocols(display_, e.subwindow, &supported_protocols, &num_supported_protocols) &&
-                find(supported_protocols, supported_protocols + num_supported_protocols, WM_DELETE_WINDOW) != supported_protocols + num_supported_protocols) {
-                LOG(INFO) << "Gracefully deleting window " << e.subwindow;
+            if (c->flags & kClientDeleteWindow) {
+                Trace(kTraceDeleteWindow, 0, e.subwindow);
                 XEvent msg = {0};
                 msg.xclient.type = ClientMessage;
                 msg.xclient.message_type = WM_PROTOCOLS;
@@ -370,160 +1388,212 @@ void WindowManager::OnButtonPress(const XButtonEvent& e) {
                 msg.xclient.data.l[0] = WM_DELETE_WINDOW;
                 CHECK(XSendEvent(display_, e.subwindow, false, 0, &msg));
             } else {
-                LOG(INFO) << "Killing window " << e.subwindow;
+                Trace(kTraceKillWindow, 0, e.subwindow);
                 XKillClient(display_, e.subwindow);
             }
         }
     }
 }
 
-void WindowManager::OnButtonRelease(const XButtonEvent& e) {}
-
-void WindowManager::OnMotionNotify(const XMotionEvent& e) {
-    if (e.subwindow == None)
+void WindowManager::OnButtonRelease(const XButtonEvent& e) {
+    if (drag_.mode == DragMode::kNone || e.button != drag_.button)
         return;
 
-    const pair<int, int> drag_pos = {e.x_root, e.y_root};
-    const pair<int, int> delta = {drag_pos.first - drag_start_pos_.first,
-                                  drag_pos.second - drag_start_pos_.second};
+    // Apply the final pointer position exactly
+    drag_.pos = {e.x_root, e.y_root};
+    ApplyDrag();
+
+    // In wireframe mode, the window is configured once, after the outline is gone
+    if (drag_.wireframe) {
+        DrawOutline(drag_.outline);
+        drag_.outline_visible = false;
+
+        Client* c = drag_.client;
+        if (drag_.outline != Rect{c->x, c->y, c->width, c->height}) {
+            c->x = drag_.outline.x;
+            c->y = drag_.outline.y;
+            c->width = drag_.outline.width;
+            c->height = drag_.outline.height;
+            XMoveResizeWindow(display_, c->window, c->x, c->y, c->width, c->height);
+            drag_.configures++;
+        }
+    }
+
+    // Once per drag, so only with GLOG_v=1
+    const long duration_ms = duration_cast<milliseconds>(Now() - drag_.start_time).count();
+    VLOG(1) << "Drag sent " << drag_.configures << " configures in " << duration_ms << " ms ("
+            << (duration_ms > 0 ? drag_.configures * 1000 / duration_ms : drag_.configures) << "/s)";
 
-    // Alt
-    if (e.state & Mod1Mask) {
-        // Alt + Left button to move
-        if (e.state & Button1Mask) {
-            const pair<int, int> dest_frame_pos = {drag_start_frame_pos_.first + delta.first,
-                                                   drag_start_frame_pos_.second + delta.second};
+    EndDrag();
+}
 
-            // Don't move window above status bar
-            if (dest_frame_pos.second < STATUS_BAR_HEIGHT)
-                return;
+void WindowManager::OnMotionNotify(const XMotionEvent& e) {
+    if (drag_.mode == DragMode::kNone)
+        return;
 
-            XMoveWindow(display_, e.subwindow, dest_frame_pos.first, dest_frame_pos.second);
-        }
+    // Keep only the latest pointer position; apply it now if a frame has passed since the last
+    // configure, otherwise the drag timer applies it when the frame is due
+    drag_.pos = {e.x_root, e.y_root};
+    drag_.pending = true;
+    if (Now() >= NextDragFrame())
+        ApplyDrag();
+    else
+        ArmDragTimer();
+}
 
-        // Alt + Right button to reisze
-        if (e.state & Button3Mask) {
-            const pair<int, int> size_delta = {max(delta.first, -drag_start_frame_size_.first),
-                                               max(delta.second, -drag_start_frame_size_.second)};
-            pair<int, int> dest_frame_size = {drag_start_frame_size_.first + size_delta.first,
-                                              drag_start_frame_size_.second + size_delta.second};
+void WindowManager::OnKeyPress(const XKeyEvent& e) {
+    const unsigned int modifiers = e.state & kModifierMask & ~(LockMask | numlock_mask_);
+    auto it = key_map_.find(KeyMapIndex(e.keycode, modifiers));
+    if (it == key_map_.end())
+        return;
 
-            // Restrict minimum window size
-            dest_frame_size.first = max(dest_frame_size.first, MIN_WINDOW_WIDTH);
-            dest_frame_size.second = max(dest_frame_size.second, MIN_WINDOW_HEIGHT);
+    const KeyBinding* binding = it->second;
+    (this->*binding->action)(binding->arg);
+}
 
-            // Resize window
-            XResizeWindow(display_, e.subwindow, dest_frame_size.first, dest_frame_size.second);
+void WindowManager::OnKeyRelease(const XKeyEvent& e) {}
+
+void WindowManager::OnMappingNotify(XMappingEvent& e) {
+    XRefreshKeyboardMapping(&e);
+    if (e.request == MappingKeyboard || e.request == MappingModifier) {
+        GrabKeys();
+        for (Window w : workspace_windows_) {
+            GrabButtons(w);
         }
     }
 }
 
-void WindowManager::OnKeyPress(const XKeyEvent& e) {
-    // Alt
-    if (e.state & Mod1Mask) {
-        // Alt + Tab to switch active window to next one
-        if (e.keycode == XKeysymToKeycode(display_, XK_Tab)) {
-            // Don't switch if there are no windows or no active window
-            if (workspaces_.size() == 0 || active_window_ == 0)
-                return;
-
-            // Find next window in workspace
-            auto it = find(workspaces_[active_workspace_].begin(), workspaces_[active_workspace_].end(), active_window_);
-            if (it == workspaces_[active_workspace_].end()) {
-                it = workspaces_[active_workspace_].begin();
-            } else {
-                it++;
-                if (it == workspaces_[active_workspace_].end())
-                    it = workspaces_[active_workspace_].begin();
-            }
+void WindowManager::OnExpose(const XExposeEvent& e) {
+    if (e.window == status_bar_->window())
+        status_bar_->OnExpose(e);
+}
 
-            FocusWindow(*it);
-            return;
-        }
+void WindowManager::OnPropertyNotify(const XPropertyEvent& e) {
+    Client* c = clients_.Find(e.window);
+    if (c == nullptr)
+        return;
 
-        // Alt + Shift
-        if (e.state & ShiftMask) {
-            // Alt + Shift + Enter to open terminal
-            if (e.keycode == XKeysymToKeycode(display_, XK_Return)) {
-                if (fork() == 0) {
-                    char* argument_list[] = {"xterm", NULL};
-                    execvp("xterm", argument_list);
-                    exit(EXIT_SUCCESS);
-                }
-                return;
-            }
+    // Only refetch properties we cache
+    if (e.atom != XA_WM_NAME && e.atom != NET_WM_NAME && e.atom != WM_PROTOCOLS &&
+        e.atom != XA_WM_CLASS && e.atom != XA_WM_NORMAL_HINTS && e.atom != NET_WM_SYNC_REQUEST_COUNTER)
+        return;
+    // WM_NAME is ignored while _NET_WM_NAME is set, so its value would be discarded
+    if (e.atom == XA_WM_NAME && (c->flags & kClientNetWMName))
+        return;
 
-            // Alt + Shift + Ctrl
-            if (e.state & ControlMask) {
-                // Alt + Shift + Ctrl + Right to move active window to next workspace
-                if (e.keycode == XKeysymToKeycode(display_, XK_Right)) {
-                    if (active_window_ == 0)
-                        return;
+    XBackend::Property value;
+    const bool exists = e.state == PropertyNewValue &&
+                        backend_.AwaitProperty(backend_.RequestProperty(e.window, e.atom), &value);
+    UpdateProperty(c, e.atom, exists ? &value : nullptr);
 
-                    // Check if there is a next workspace
-                    if (active_workspace_ == num_workspaces_ - 1)
-                        return;
+    if (c == active_client_ && (e.atom == XA_WM_NAME || e.atom == NET_WM_NAME))
+        WriteToStatusBar(c->title);
+}
 
-                    // Hide window
-                    XWithdrawWindow(display_, active_window_, DefaultScreen(display_));
+void WindowManager::FocusNextClient(int arg) {
+    // Don't switch if there are no windows or no active window
+    if (clients_.NumClients(active_workspace_) == 0 || active_client_ == nullptr)
+        return;
 
-                    // Move window to next workspace
-                    workspaces_[active_workspace_].erase(find(workspaces_[active_workspace_].begin(), workspaces_[active_workspace_].end(), active_window_));
-                    workspaces_[active_workspace_ + 1].push_back(active_window_);
-                    active_window_ = 0;
+    // Next window in workspace, or the first one if the active window is on another workspace
+    if (active_client_->workspace != active_workspace_) {
+        FocusWindow(clients_.First(active_workspace_));
+        return;
+    }
+    FocusWindow(clients_.Next(active_client_));
+}
 
-                    WriteToStatusBar("");
-                    return;
-                }
+void WindowManager::SpawnTerminal(int arg) {
+    Spawn(TERMINAL_COMMAND);
+}
 
-                // Alt + Shift + Ctrl + Left to move active window to previous workspace
-                if (e.keycode == XKeysymToKeycode(display_, XK_Left)) {
-                    if (active_window_ == 0)
-                        return;
+void WindowManager::ShiftWorkspace(int delta) {
+    const int workspace = active_workspace_ + delta;
 
-                    // Check if there is a previous workspace
-                    if (active_workspace_ == 0)
-                        return;
+    // There is no workspace before the first one
+    if (workspace < 0)
+        return;
 
-                    // Hide window
-                    XWithdrawWindow(display_, active_window_, DefaultScreen(display_));
+    // Create new workspace if on the last one
+    if (workspace == clients_.NumWorkspaces()) {
+        CreateWorkspace();
+        return;
+    }
 
-                    // Move window to previous workspace
-                    workspaces_[active_workspace_].erase(find(workspaces_[active_workspace_].begin(), workspaces_[active_workspace_].end(), active_window_));
-                    workspaces_[active_workspace_ - 1].push_back(active_window_);
-                    active_window_ = 0;
+    SwitchWorkspace(workspace);
+}
 
-                    WriteToStatusBar("");
-                    return;
-                }
-            }
-        }
+void WindowManager::MoveActiveClient(int delta) {
+    if (active_client_ == nullptr)
+        return;
 
-        // Alt + Ctrl
-        if (e.state & ControlMask) {
-            // Alt + Ctrl + Right to switch to next workspace
-            if (e.keycode == XKeysymToKeycode(display_, XK_Right)) {
-                // Switch to next workspace
-                if (active_workspace_ < num_workspaces_ - 1) {
-                    SwitchWorkspace(active_workspace_ + 1);
-                } else {
-                    // Create new workspace if on the last one
-                    CreateWorkspace();
-                }
-                return;
-            }
+    // Check if there is a workspace to move to
+    const int workspace = active_workspace_ + delta;
+    if (workspace < 0 || workspace >= clients_.NumWorkspaces())
+        return;
 
-            // Alt + Ctrl + Left to switch to previous workspace
-            if (e.keycode == XKeysymToKeycode(display_, XK_Left)) {
-                // Switch to previous workspace if we are not on the first one
-                if (active_workspace_ == 0)
-                    return;
+    MoveClientToWorkspace(active_client_, workspace);
+}
 
-                SwitchWorkspace(active_workspace_ - 1);
-                return;
-            }
-        }
+void WindowManager::MoveClientToWorkspace(Client* c, int workspace) {
+    if (c->workspace == workspace)
+        return;
+
+    // Reparenting into another workspace window hides or shows the window
+    if (c == active_client_) {
+        SetBorderState(c, BorderState::kInactive);
+        active_client_ = nullptr;
+        ewmh_dirty_ |= kEwmhActiveWindow;
+        WriteToStatusBar("");
     }
+    const int previous_workspace = c->workspace;
+    XReparentWindow(display_, c->window, workspace_windows_[workspace], c->x, c->y);
+    clients_.MoveToWorkspace(c, workspace);
+    // The client list is ordered by workspace
+    ewmh_dirty_ |= kEwmhClientList;
+    ArrangeWorkspace(previous_workspace);
+    ArrangeWorkspace(workspace);
 }
 
-void WindowManager::OnKeyRelease(const XKeyEvent& e) {}
+void WindowManager::CycleLayout(int arg) {
+    const Layout layout = static_cast<Layout>((static_cast<int>(clients_.layout(active_workspace_)) + 1) %
+                                              static_cast<int>(Layout::kNumLayouts));
+    clients_.SetLayout(active_workspace_, layout);
+    ArrangeWorkspace(active_workspace_);
+    WriteToStatusBar(active_client_ ? active_client_->title : "");
+}
+
+void WindowManager::ArrangeWorkspace(int workspace) {
+    const Layout layout = clients_.layout(workspace);
+    if (layout == Layout::kFloating)
+        return;
+
+    tiled_clients_.clear();
+    clients_.ForEachClient(workspace, [this](Client* c) { tiled_clients_.push_back(c); });
+    tiled_rects_.resize(tiled_clients_.size());
+    const Rect area = {0,
+                       STATUS_BAR_HEIGHT,
+                       static_cast<unsigned int>(DisplayWidth(display_, DefaultScreen(display_))),
+                       static_cast<unsigned int>(DisplayHeight(display_, DefaultScreen(display_)) - STATUS_BAR_HEIGHT)};
+    ComputeLayout(layout, tiled_clients_.size(), area, tiled_rects_.data());
+
+    // Cells include the active border, so focus changes don't move windows. Clients whose cell
+    // didn't change are not configured, so they don't repaint.
+    const unsigned int borders = 2 * BORDER_WIDTH_ACTIVE;
+    for (size_t i = 0; i < tiled_clients_.size(); i++) {
+        Client* c = tiled_clients_[i];
+        const Rect& cell = tiled_rects_[i];
+        const Rect geometry = {cell.x,
+                               cell.y,
+                               cell.width > borders ? cell.width - borders : 1,
+                               cell.height > borders ? cell.height - borders : 1};
+        if (geometry == Rect{c->x, c->y, c->width, c->height})
+            continue;
+
+        c->x = geometry.x;
+        c->y = geometry.y;
+        c->width = geometry.width;
+        c->height = geometry.height;
+        XMoveResizeWindow(display_, c->window, c->x, c->y, c->width, c->height);
+    }
+}
\ No newline at end of file
@@ -1,25 +1,121 @@
 
 #include <X11/Xlib.h>
+#include <X11/extensions/sync.h>
 
 #pragma once
 
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
+#include "client_registry.hpp"
+#ifdef MSWM_COMPOSITOR
+#include "compositor.hpp"
+#endif
+#include "control_server.hpp"
+#include "edge_index.hpp"
+#include "event_log.hpp"
+#include "snapshot.hpp"
+#include "status_bar.hpp"
+#include "status_providers.hpp"
+#ifdef MSWM_STATS
+#include "stats.hpp"
+#endif
+#include "x_backend.hpp"
+
 class WindowManager {
    public:
     static std::unique_ptr<WindowManager> Create();
     ~WindowManager();
     void Run();
+    // Paces drags by the given clock instead of the steady clock and the drag timer, which
+    // mswm_replay uses to replay them at the recorded times. A frame that has become due is
+    // applied before the next event is handled.
+    void SetClock(std::function<std::chrono::steady_clock::time_point()> clock) { clock_ = std::move(clock); }
 
    private:
     WindowManager(Display* display);
 
-    void SetWindowBorder(const Window& w, unsigned int width, const char* color_str);
-    void FocusWindow(const Window& w);
+    void SetBorderState(Client* c, BorderState state);
+    void FocusWindow(Client* c);
+    // Property fetches are split so that the properties of many windows can be requested at once
+    static const int kNumClientProperties = 6;
+    void RequestProperties(Window w, XBackend::PropertyCookie* cookies);
+    void AwaitProperties(Client* c, const XBackend::PropertyCookie* cookies);
+    void UpdateProperty(Client* c, Atom property, const XBackend::Property* value);
     void WriteToStatusBar(const std::string message);
+    void CreateOutlineGC();
+    // Sets the EWMH root properties that don't change, and the check window's
+    void AnnounceEwmh();
     void SwitchWorkspace(const int workspace);
     void CreateWorkspace();
+    Window CreateWorkspaceWindow();
+    void DestroyUnusedWorkspaceWindows();
+    // Applies the workspace's tiling layout, configuring only the clients whose geometry changed
+    void ArrangeWorkspace(int workspace);
+    // Manages the windows that were mapped before we started
+    void AdoptExistingWindows();
+
+    // In-place restart. The state is stored on the root window and the workspace windows are kept
+    // alive across the exec, so clients are not remapped. Everything else of the old process is
+    // freed before the exec.
+    void SaveState();
+    bool RestoreState();
+
+    // Key binding actions
+    void FocusNextClient(int arg);
+    void SpawnTerminal(int arg);
+    void ShiftWorkspace(int delta);
+    void MoveActiveClient(int delta);
+    void MoveClientToWorkspace(Client* c, int workspace);
+    void Restart(int arg);
+    void CycleLayout(int arg);
+
+    struct KeyBinding {
+        unsigned int modifiers;
+        KeySym keysym;
+        void (WindowManager::*action)(int);
+        int arg;
+    };
+    static const KeyBinding kKeyBindings[];
+
+    unsigned int LockModifierVariant(int i) const;
+    void GrabButtons(Window w);
+    void GrabKeys();
+
+    // Server grabs don't nest, so they are counted
+    void GrabServer();
+    void UngrabServer();
+
+    void ExecuteControlBatch(const ControlCommand* commands,
+                             size_t num_commands,
+                             ControlReplyHeader* header,
+                             std::string* records);
+
+    // XNextEvent that also records the event when recording
+    void NextEvent(XEvent* e);
+    void HandleEvent(XEvent& e);
+    // Writes the EWMH root properties marked in ewmh_dirty_
+    void PublishEwmh();
+    void OnDragTimer();
+    void OnSignal();
+    void OnStatusProviders();
+    // The time drags are paced by
+    std::chrono::steady_clock::time_point Now() const;
+    std::chrono::steady_clock::time_point NextDragFrame() const;
+    // Arms the drag timer for the next frame
+    void ArmDragTimer();
+    void ApplyDrag();
+    void EndDrag();
+    void DrawOutline(const Rect& frame);
+    // Fills snap_edges_ with the screen edges and the frames of the other clients on the workspace
+    void IndexSnapEdges(const Client* dragged);
+    // Offset that snaps the far side of a dragged frame, or when moving either side, to the
+    // nearest edge in snap_edges_. begin and end are the sides along axis, span the other extent.
+    int SnapOffset(EdgeIndex::Axis axis, int begin, int end, int span_begin, int span_end) const;
+    void OnSyncAlarm(const XSyncAlarmNotifyEvent& e);
 
     static int OnWMDetected(Display* display, XErrorEvent* e);
     static int OnXError(Display* display, XErrorEvent* e);
@@ -37,22 +133,139 @@ class WindowManager {
     void OnMotionNotify(const XMotionEvent& e);
     void OnKeyPress(const XKeyEvent& e);
     void OnKeyRelease(const XKeyEvent& e);
+    void OnMappingNotify(XMappingEvent& e);
+    void OnExpose(const XExposeEvent& e);
+    void OnPropertyNotify(const XPropertyEvent& e);
 
    private:
     Display* display_;
     const Window root_;
+    XBackend backend_;
     static bool wm_detected_;
 
     int active_workspace_ = 0;
-    int num_workspaces_ = 1;
-    Window active_window_ = 0;
-    std::vector<std::vector<Window>> workspaces_;  // Vector of windows in every workspace
-    Window status_bar_window_;
+    Client* active_client_ = nullptr;
+    ClientRegistry clients_;
+
+    // The system segments from kCpuSegment on are right-aligned
+    enum StatusBarSegment {
+        kWorkspaceSegment,
+        kTitleSegment,
+        kCpuSegment,
+        kMemorySegment,
+        kLoadSegment,
+        kBatterySegment,
+        kClockSegment,
+        kNumStatusBarSegments,
+    };
+    std::unique_ptr<StatusBar> status_bar_;
+    // Fills the system state segments
+    std::unique_ptr<StatusProviders> status_providers_;
+    std::unique_ptr<ControlServer> control_server_;
+    int server_grabs_ = 0;
+
+    // EWMH root properties that changed since they were last written. They are written once per
+    // event loop iteration, so a burst of events causes a single update.
+    enum EwmhProperty : unsigned int {
+        kEwmhClientList = 1 << 0,
+        kEwmhActiveWindow = 1 << 1,
+        kEwmhCurrentDesktop = 1 << 2,
+        kEwmhNumberOfDesktops = 1 << 3,
+        kEwmhAll = (1 << 4) - 1,
+    };
+    unsigned int ewmh_dirty_ = kEwmhAll;
+    bool running_ = true;
+
+    // The event loop waits on epoll_fd_ for the X connection, timer_fd_, signal_fd_ and the
+    // control socket
+    int epoll_fd_ = -1;
+    int timer_fd_ = -1;
+    int signal_fd_ = -1;
+    // Replaces the steady clock and timer_fd_ if set
+    std::function<std::chrono::steady_clock::time_point()> clock_;
+
+    // Every workspace is a full-screen container window that its clients are reparented into.
+    // Switching workspaces maps one container and unmaps another instead of touching every client.
+    std::vector<Window> workspace_windows_;
+
+    // Scratch buffers for ArrangeWorkspace
+    std::vector<Client*> tiled_clients_;
+    std::vector<Rect> tiled_rects_;
+
+    // Key bindings resolved to keycodes, indexed by (keycode, modifiers without lock modifiers).
+    // Rebuilt when the keyboard mapping changes.
+    std::unordered_map<unsigned int, const KeyBinding*> key_map_;
+    unsigned int numlock_mask_ = 0;
+
+    // Border pixels are resolved once at startup; every client's current border state is
+    // remembered so that a focus change only touches the clients whose state changes.
+    unsigned long border_pixel_active_;
+    unsigned long border_pixel_inactive_;
+    GC outline_gc_;
+
+    // Interactive move/resize. Motion events only record the latest pointer position, which is
+    // applied to the window at most once per frame and exactly on button release. Clients that
+    // support _NET_WM_SYNC_REQUEST are resized again only once they have painted the last size.
+    // An alarm on their sync counter reports that.
+    enum class DragMode {
+        kNone,
+        kMove,
+        kResize,
+    };
+
+    struct Drag {
+        DragMode mode = DragMode::kNone;
+        // The drag ends when this button is released
+        unsigned int button = 0;
+        Client* client = nullptr;
+        std::pair<int, int> start_pos;
+        std::pair<int, int> start_frame_pos;
+        std::pair<int, int> start_frame_size;
+        std::pair<int, int> pos;
+        bool pending = false;
+        std::chrono::steady_clock::time_point start_time;
+        std::chrono::steady_clock::time_point last_apply_time;
+        unsigned int configures = 0;
+
+        XSyncAlarm sync_alarm = None;
+        int64_t sync_value = 0;
+        bool awaiting_sync = false;
+
+        // Wireframe mode only moves an outline, drawn under a server grab, until the button is
+        // released
+        bool wireframe = false;
+        Rect outline;
+        bool outline_visible = false;
+    };
+    Drag drag_;
+    // Edges the dragged window snaps to, built when the drag starts
+    EdgeIndex snap_edges_;
+    // First event code of the XSync extension, or -1 if it is missing
+    int sync_event_base_ = -1;
 
-    std::pair<int, int> drag_start_pos_;
-    std::pair<int, int> drag_start_frame_pos_;
-    std::pair<int, int> drag_start_frame_size_;
+#ifdef MSWM_STATS
+    EventStats stats_;
+#endif
+    // Set while recording events to $MSWM_RECORD
+    std::unique_ptr<EventRecorder> recorder_;
+#ifdef MSWM_COMPOSITOR
+    // Null if compositing is unavailable
+    std::unique_ptr<Compositor> compositor_;
+#endif
 
-    const Atom WM_PROTOCOLS;
-    const Atom WM_DELETE_WINDOW;
+    // Atoms interned at startup
+    static const std::pair<Atom WindowManager::*, const char*> kAtoms[];
+    Atom WM_PROTOCOLS;
+    Atom WM_DELETE_WINDOW;
+    Atom NET_WM_NAME;
+    Atom MSWM_STATE;
+    Atom NET_WM_SYNC_REQUEST;
+    Atom NET_WM_SYNC_REQUEST_COUNTER;
+    Atom NET_SUPPORTED;
+    Atom NET_SUPPORTING_WM_CHECK;
+    Atom NET_CLIENT_LIST;
+    Atom NET_ACTIVE_WINDOW;
+    Atom NET_CURRENT_DESKTOP;
+    Atom NET_NUMBER_OF_DESKTOPS;
+    Atom UTF8_STRING;
 };
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include <X11/Xlib.h>
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#ifdef MSWM_BACKEND_XCB
+#include <xcb/xcb.h>
+#endif
+
+// X requests that need a reply from the server. Each Request* call sends a request and returns a
+// cookie; the matching Await* call waits for the reply. With the XCB backend (make BACKEND=xcb)
+// several requests can be in flight before the first reply is awaited, so a batch of requests
+// costs a single round trip. The Xlib backend makes the blocking call in Await*.
+//
+// Every cookie must be awaited exactly once.
+class XBackend {
+   public:
+    explicit XBackend(Display* display);
+
+    struct Geometry {
+        int x, y;
+        unsigned int width, height, border_width;
+    };
+
+    struct Attributes {
+        bool override_redirect;
+        int map_state;  // IsUnmapped, IsUnviewable or IsViewable
+        bool input_only;
+        VisualID visual;
+    };
+
+    struct Property {
+        Atom type = None;
+        int format = 0;
+        std::string bytes;                 // Format 8
+        std::vector<unsigned long> values;  // Format 16 and 32
+    };
+
+    struct GeometryCookie {
+        unsigned int sequence;
+        Window window;
+    };
+
+    struct AttributesCookie {
+        unsigned int sequence;
+        Window window;
+    };
+
+    struct TreeCookie {
+        unsigned int sequence;
+        Window window;
+    };
+
+    struct PropertyCookie {
+        unsigned int sequence;
+        Window window;
+        Atom property;
+        long max_length;
+    };
+
+    struct ColorCookie {
+        unsigned int sequence;
+        const char* name;
+    };
+
+    GeometryCookie RequestGeometry(Window w);
+    bool AwaitGeometry(const GeometryCookie& cookie, Geometry* geometry);
+
+    AttributesCookie RequestAttributes(Window w);
+    bool AwaitAttributes(const AttributesCookie& cookie, Attributes* attributes);
+
+    // Children of a window, bottom-most first
+    TreeCookie RequestTree(Window w);
+    bool AwaitTree(const TreeCookie& cookie, std::vector<Window>* children);
+
+    // Fetches up to max_length 32-bit units of a property of any type
+    PropertyCookie RequestProperty(Window w, Atom property, long max_length = 1024);
+    bool AwaitProperty(const PropertyCookie& cookie, Property* property);
+
+    // Allocates a named color in the default colormap
+    ColorCookie RequestNamedColor(const char* name);
+    bool AwaitNamedColor(const ColorCookie& cookie, unsigned long* pixel);
+
+   private:
+    Display* display_;
+#ifdef MSWM_BACKEND_XCB
+    xcb_connection_t* connection_;
+#endif
+};
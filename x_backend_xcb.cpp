@@ -0,0 +1,111 @@
+#include <X11/Xlib-xcb.h>
+
+#include <cstdlib>
+#include <cstring>
+
+#include "x_backend.hpp"
+
+// Requests are sent on the connection shared with Xlib. Xlib flushes its own pending requests
+// before XCB writes, so ordering relative to the Xlib calls in WindowManager is preserved. Errors
+// of these unchecked requests are delivered to the Xlib error handler.
+
+XBackend::XBackend(Display* display) : display_(display),
+                                       connection_(XGetXCBConnection(display)) {}
+
+XBackend::GeometryCookie XBackend::RequestGeometry(Window w) {
+    return {xcb_get_geometry_unchecked(connection_, w).sequence, w};
+}
+
+bool XBackend::AwaitGeometry(const GeometryCookie& cookie, Geometry* geometry) {
+    xcb_get_geometry_reply_t* reply = xcb_get_geometry_reply(connection_, {cookie.sequence}, nullptr);
+    if (reply == nullptr)
+        return false;
+
+    geometry->x = reply->x;
+    geometry->y = reply->y;
+    geometry->width = reply->width;
+    geometry->height = reply->height;
+    geometry->border_width = reply->border_width;
+    free(reply);
+    return true;
+}
+
+XBackend::AttributesCookie XBackend::RequestAttributes(Window w) {
+    return {xcb_get_window_attributes_unchecked(connection_, w).sequence, w};
+}
+
+bool XBackend::AwaitAttributes(const AttributesCookie& cookie, Attributes* attributes) {
+    xcb_get_window_attributes_reply_t* reply = xcb_get_window_attributes_reply(connection_, {cookie.sequence}, nullptr);
+    if (reply == nullptr)
+        return false;
+
+    attributes->override_redirect = reply->override_redirect;
+    attributes->map_state = reply->map_state;
+    attributes->input_only = reply->_class == XCB_WINDOW_CLASS_INPUT_ONLY;
+    attributes->visual = reply->visual;
+    free(reply);
+    return true;
+}
+
+XBackend::TreeCookie XBackend::RequestTree(Window w) {
+    return {xcb_query_tree_unchecked(connection_, w).sequence, w};
+}
+
+bool XBackend::AwaitTree(const TreeCookie& cookie, std::vector<Window>* children) {
+    xcb_query_tree_reply_t* reply = xcb_query_tree_reply(connection_, {cookie.sequence}, nullptr);
+    if (reply == nullptr)
+        return false;
+
+    const xcb_window_t* items = xcb_query_tree_children(reply);
+    children->assign(items, items + xcb_query_tree_children_length(reply));
+    free(reply);
+    return true;
+}
+
+XBackend::PropertyCookie XBackend::RequestProperty(Window w, Atom property, long max_length) {
+    xcb_get_property_cookie_t c = xcb_get_property_unchecked(
+        connection_, false, w, property, XCB_GET_PROPERTY_TYPE_ANY, 0, max_length);
+    return {c.sequence, w, property, max_length};
+}
+
+bool XBackend::AwaitProperty(const PropertyCookie& cookie, Property* property) {
+    xcb_get_property_reply_t* reply = xcb_get_property_reply(connection_, {cookie.sequence}, nullptr);
+    if (reply == nullptr)
+        return false;
+
+    property->type = reply->type;
+    property->format = reply->format;
+    property->bytes.clear();
+    property->values.clear();
+
+    const void* data = xcb_get_property_value(reply);
+    const int length = xcb_get_property_value_length(reply);
+    if (reply->format == 8) {
+        property->bytes.assign(static_cast<const char*>(data), length);
+    } else if (reply->format == 16) {
+        const uint16_t* items = static_cast<const uint16_t*>(data);
+        property->values.assign(items, items + length / 2);
+    } else if (reply->format == 32) {
+        const uint32_t* items = static_cast<const uint32_t*>(data);
+        property->values.assign(items, items + length / 4);
+    }
+
+    free(reply);
+    return property->type != None;
+}
+
+XBackend::ColorCookie XBackend::RequestNamedColor(const char* name) {
+    Colormap colormap = DefaultColormap(display_, DefaultScreen(display_));
+    xcb_alloc_named_color_cookie_t c = xcb_alloc_named_color(connection_, colormap, strlen(name), name);
+    return {c.sequence, name};
+}
+
+bool XBackend::AwaitNamedColor(const ColorCookie& cookie, unsigned long* pixel) {
+    xcb_alloc_named_color_reply_t* reply = xcb_alloc_named_color_reply(connection_, {cookie.sequence}, nullptr);
+    if (reply == nullptr)
+        return false;
+
+    *pixel = reply->pixel;
+    free(reply);
+    return true;
+}
@@ -0,0 +1,108 @@
+#include <X11/Xatom.h>
+
+#include "x_backend.hpp"
+
+XBackend::XBackend(Display* display) : display_(display) {}
+
+XBackend::GeometryCookie XBackend::RequestGeometry(Window w) {
+    return {0, w};
+}
+
+bool XBackend::AwaitGeometry(const GeometryCookie& cookie, Geometry* geometry) {
+    Window returned_root;
+    unsigned int depth;
+    return XGetGeometry(display_,
+                        cookie.window,
+                        &returned_root,
+                        &geometry->x,
+                        &geometry->y,
+                        &geometry->width,
+                        &geometry->height,
+                        &geometry->border_width,
+                        &depth);
+}
+
+XBackend::AttributesCookie XBackend::RequestAttributes(Window w) {
+    return {0, w};
+}
+
+bool XBackend::AwaitAttributes(const AttributesCookie& cookie, Attributes* attributes) {
+    XWindowAttributes attrs;
+    if (!XGetWindowAttributes(display_, cookie.window, &attrs))
+        return false;
+    attributes->override_redirect = attrs.override_redirect;
+    attributes->map_state = attrs.map_state;
+    attributes->input_only = attrs.c_class == InputOnly;
+    attributes->visual = XVisualIDFromVisual(attrs.visual);
+    return true;
+}
+
+XBackend::TreeCookie XBackend::RequestTree(Window w) {
+    return {0, w};
+}
+
+bool XBackend::AwaitTree(const TreeCookie& cookie, std::vector<Window>* children) {
+    Window returned_root, parent;
+    Window* items = nullptr;
+    unsigned int num_items;
+    if (!XQueryTree(display_, cookie.window, &returned_root, &parent, &items, &num_items))
+        return false;
+
+    children->assign(items, items + num_items);
+    if (items != nullptr)
+        XFree(items);
+    return true;
+}
+
+XBackend::PropertyCookie XBackend::RequestProperty(Window w, Atom property, long max_length) {
+    return {0, w, property, max_length};
+}
+
+bool XBackend::AwaitProperty(const PropertyCookie& cookie, Property* property) {
+    unsigned long num_items, bytes_after;
+    unsigned char* data = nullptr;
+    if (XGetWindowProperty(display_,
+                           cookie.window,
+                           cookie.property,
+                           0,
+                           cookie.max_length,
+                           false,
+                           AnyPropertyType,
+                           &property->type,
+                           &property->format,
+                           &num_items,
+                           &bytes_after,
+                           &data) != Success) {
+        return false;
+    }
+
+    // Xlib returns format 32 items as longs and format 16 items as shorts
+    property->bytes.clear();
+    property->values.clear();
+    if (property->format == 8) {
+        property->bytes.assign(reinterpret_cast<char*>(data), num_items);
+    } else if (property->format == 16) {
+        const unsigned short* items = reinterpret_cast<unsigned short*>(data);
+        property->values.assign(items, items + num_items);
+    } else if (property->format == 32) {
+        const unsigned long* items = reinterpret_cast<unsigned long*>(data);
+        property->values.assign(items, items + num_items);
+    }
+
+    if (data != nullptr)
+        XFree(data);
+    return property->type != None;
+}
+
+XBackend::ColorCookie XBackend::RequestNamedColor(const char* name) {
+    return {0, name};
+}
+
+bool XBackend::AwaitNamedColor(const ColorCookie& cookie, unsigned long* pixel) {
+    Colormap colormap = DefaultColormap(display_, DefaultScreen(display_));
+    XColor color;
+    if (!XAllocNamedColor(display_, colormap, cookie.name, &color, &color))
+        return false;
+    *pixel = color.pixel;
+    return true;
+}